@@ -0,0 +1,63 @@
+#include <iostream>
+#include <random>
+#include <chrono>
+
+#include <raytracer/geometry.hpp>
+
+// NB: Node memory and closest hit throughput of every BVH layout
+// on the same mesh of small random triangles.
+
+static constexpr int kNumTriangles = 200000;
+static constexpr int kNumRays      = 200000;
+
+int main() {
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> pos(-10, 10);
+    std::uniform_real_distribution<double> offset(-0.2, 0.2);
+
+    auto buffers = std::make_shared<MeshBuffers>();
+    MeshIndices indices;
+    for (int tri = 0; tri < kNumTriangles; ++tri) {
+        Vec3f c{pos(gen), pos(gen), pos(gen)};
+        for (int k = 0; k < 3; ++k) {
+            indices.v.push_back(static_cast<int>(buffers->px.size()));
+            buffers->px.push_back(c.x + offset(gen));
+            buffers->py.push_back(c.y + offset(gen));
+            buffers->pz.push_back(c.z + offset(gen));
+        }
+    }
+
+    auto mesh = std::make_shared<TriangleMesh>(buffers, std::move(indices));
+    Scene scene{{mesh}, {}, {}};
+
+    std::vector<Ray> rays;
+    for (int i = 0; i < kNumRays; ++i) {
+        rays.push_back(Ray{{pos(gen), pos(gen), pos(gen)},
+                           Vec3f{pos(gen), pos(gen), pos(gen)}.normalize()});
+    }
+
+    const std::pair<const char*, BVHLayout> layouts[] = {
+        {"binary", BVHLayout::kBinary},
+        {"wide4 ", BVHLayout::kWide4},
+        {"wide8 ", BVHLayout::kWide8},
+    };
+
+    for (const auto& [name, layout] : layouts) {
+        scene.SetBVHLayout(layout);
+
+        using namespace std::chrono;
+        int  hits  = 0;
+        auto start = high_resolution_clock::now();
+        for (const auto& ray : rays) {
+            hits += scene.Intersect(ray).has_value();
+        }
+        auto end = high_resolution_clock::now();
+        double seconds = duration<double>(end - start).count();
+
+        std::cout << "[INFO] " << name
+                  << ": nodes " << mesh->GetBVHMemoryUsage() / 1024 << " KiB"
+                  << ", " << kNumRays / seconds / 1e6 << " Mrays/s"
+                  << ", hits " << hits << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,68 @@
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <cstdio>
+#include <algorithm>
+
+#include <raytracer/render.hpp>
+
+// NB: Overhead of RenderCheckpointed over Render, at the default interval
+// and at a short one, on a field of reflective spheres.
+
+static constexpr int kNumSpheres = 2000;
+static constexpr int kRepeats    = 5;
+
+template <typename F>
+static double Best(F&& f) {
+    using namespace std::chrono;
+    double best = 0;
+    for (int k = 0; k < kRepeats; ++k) {
+        auto start = high_resolution_clock::now();
+        f();
+        auto end   = high_resolution_clock::now();
+        const double ms = duration<double, std::milli>(end - start).count();
+        best = k == 0 ? ms : std::min(best, ms);
+    }
+    return best;
+}
+
+static Scene MakeScene() {
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> pos(-10, 10);
+    std::uniform_real_distribution<double> color(0.1, 0.9);
+
+    Objects objects;
+    for (int i = 0; i < kNumSpheres; ++i) {
+        Material material;
+        material.Kd    = {color(gen), color(gen), color(gen)};
+        material.Ks    = {0.3, 0.3, 0.3};
+        material.Ns    = 20;
+        material.illum = 3;
+        objects.push_back(std::make_shared<Sphere>(Vec3f{pos(gen), pos(gen), pos(gen)}, 0.5, material));
+    }
+
+    Scene scene{std::move(objects), {}, {}};
+    scene.AddLight(Light{{0, 20, 20}, {1, 1, 1}});
+    return scene;
+}
+
+int main() {
+    const auto scene = MakeScene();
+
+    CameraOptions camera(1000, 1000);
+    camera.look_from = {0, 0, 25};
+    RenderOptions options{4};
+
+    const double render_ms = Best([&]() { Render(scene, camera, options); });
+    std::cout << "[INFO] Render: " << render_ms << " ms" << std::endl;
+
+    const std::string path = "bench_checkpoint.ckpt";
+    for (double interval_ms : {60000.0, 1000.0, 100.0}) {
+        const double ms = Best([&]() {
+            RenderCheckpointed(scene, camera, options, CheckpointOptions{path, interval_ms, {}});
+        });
+        std::cout << "[INFO] RenderCheckpointed every " << interval_ms << " ms: " << ms << " ms ("
+                  << (ms / render_ms - 1) * 100 << "% overhead)" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,70 @@
+#include <iostream>
+#include <random>
+#include <chrono>
+
+#include <raytracer/geometry.hpp>
+
+// NB: A grid of rotated instances of one mesh, 10^9 effective triangles
+// from 10^5 unique ones.
+
+static constexpr int kNumTriangles = 100000;
+static constexpr int kGridSize     = 100;
+static constexpr int kNumRays      = 100000;
+
+int main() {
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> pos(-1, 1);
+    std::uniform_real_distribution<double> offset(-0.02, 0.02);
+    std::uniform_real_distribution<double> angle(0, 2 * M_PI);
+
+    auto buffers = std::make_shared<MeshBuffers>();
+    MeshIndices indices;
+    for (int tri = 0; tri < kNumTriangles; ++tri) {
+        Vec3f c{pos(gen), pos(gen), pos(gen)};
+        for (int k = 0; k < 3; ++k) {
+            indices.v.push_back(static_cast<int>(buffers->px.size()));
+            buffers->px.push_back(c.x + offset(gen));
+            buffers->py.push_back(c.y + offset(gen));
+            buffers->pz.push_back(c.z + offset(gen));
+        }
+    }
+    auto mesh = std::make_shared<TriangleMesh>(buffers, std::move(indices));
+
+    using namespace std::chrono;
+    auto start = high_resolution_clock::now();
+    mesh->Commit();
+
+    Objects objects;
+    for (int i = 0; i < kGridSize; ++i) {
+        for (int j = 0; j < kGridSize; ++j) {
+            auto t = Transform::Translate({3.0 * i, 0, 3.0 * j}) *
+                     Transform::Rotate({0, 1, 0}, angle(gen));
+            objects.push_back(std::make_shared<Instance>(mesh, t));
+        }
+    }
+    Scene scene{std::move(objects), {}, {}};
+    auto end = high_resolution_clock::now();
+
+    std::cout << "[INFO] Effective triangles: "
+              << static_cast<double>(kNumTriangles) * kGridSize * kGridSize << std::endl;
+    std::cout << "[INFO] Build time: " << duration<double, std::milli>(end - start).count()
+              << " ms" << std::endl;
+
+    std::vector<Ray> rays;
+    for (int i = 0; i < kNumRays; ++i) {
+        Vec3f target{3.0 * kGridSize * (pos(gen) + 1) / 2, 0, 3.0 * kGridSize * (pos(gen) + 1) / 2};
+        Vec3f orig{-10, 20, -10};
+        rays.push_back(Ray{orig, (target - orig).normalize()});
+    }
+
+    int hits = 0;
+    start = high_resolution_clock::now();
+    for (const auto& ray : rays) {
+        hits += scene.Intersect(ray).has_value();
+    }
+    end = high_resolution_clock::now();
+
+    std::cout << "[INFO] " << kNumRays / duration<double>(end - start).count() / 1e6
+              << " Mrays/s, hits " << hits << std::endl;
+    return 0;
+}
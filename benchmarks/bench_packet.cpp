@@ -0,0 +1,73 @@
+#include <iostream>
+#include <random>
+#include <chrono>
+
+#include <raytracer/geometry.hpp>
+
+// NB: Cost of testing one ray against a packet of four triangles
+// with the scalar kernel and with the runtime-selected one.
+
+static constexpr int kNumPackets = 1024;
+static constexpr int kNumRays    = 2048;
+
+template <typename F>
+static double Measure(F&& f) {
+    using namespace std::chrono;
+    auto start = high_resolution_clock::now();
+    f();
+    auto end   = high_resolution_clock::now();
+    return duration<double, std::nano>(end - start).count() /
+           (static_cast<double>(kNumPackets) * TrianglePacket::kWidth * kNumRays);
+}
+
+int main() {
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> pos(-1, 1);
+
+    std::vector<TrianglePacket> packets(kNumPackets);
+    for (auto& packet : packets) {
+        for (int lane = 0; lane < TrianglePacket::kWidth; ++lane) {
+            packet.tri[lane] = lane;
+            packet.v0x[lane] = pos(gen);
+            packet.v0y[lane] = pos(gen);
+            packet.v0z[lane] = pos(gen) - 3;
+            packet.e1x[lane] = pos(gen);
+            packet.e1y[lane] = pos(gen);
+            packet.e1z[lane] = pos(gen);
+            packet.e2x[lane] = pos(gen);
+            packet.e2y[lane] = pos(gen);
+            packet.e2z[lane] = pos(gen);
+        }
+    }
+
+    std::vector<Ray> rays;
+    for (int i = 0; i < kNumRays; ++i) {
+        rays.push_back(Ray{{0, 0, 0}, Vec3f{pos(gen), pos(gen), -1}.normalize()});
+    }
+
+    int hits_scalar = 0, hits_simd = 0;
+    double u, v;
+
+    double scalar = Measure([&]() {
+        for (const auto& ray : rays) {
+            double t = 100;
+            for (const auto& packet : packets) {
+                hits_scalar += IntersectPacketScalar(packet, ray, &t, &u, &v) >= 0;
+            }
+        }
+    });
+
+    double simd = Measure([&]() {
+        for (const auto& ray : rays) {
+            double t = 100;
+            for (const auto& packet : packets) {
+                hits_simd += IntersectPacket(packet, ray, &t, &u, &v) >= 0;
+            }
+        }
+    });
+
+    std::cout << "[INFO] Hits: " << hits_scalar << " / " << hits_simd << std::endl;
+    std::cout << "[INFO] Scalar kernel:   " << scalar << " ns/triangle" << std::endl;
+    std::cout << "[INFO] Selected kernel: " << simd   << " ns/triangle" << std::endl;
+    return 0;
+}
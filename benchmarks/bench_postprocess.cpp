@@ -0,0 +1,55 @@
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+#include <raytracer/render.hpp>
+#include <raytracer/postprocess.hpp>
+
+// NB: The reference and the table tone-mapping kernels on a 4K frame, then
+// Render of 4K frames of a single emissive sphere filling the screen, so
+// tracing is cheap and postprocessing is a large part of the runtime.
+
+static constexpr int kRepeats = 5;
+
+template <typename F>
+static double Best(F&& f) {
+    using namespace std::chrono;
+    double best = 0;
+    for (int k = 0; k < kRepeats; ++k) {
+        auto start = high_resolution_clock::now();
+        f();
+        auto end   = high_resolution_clock::now();
+        const double ms = duration<double, std::milli>(end - start).count();
+        best = k == 0 ? ms : std::min(best, ms);
+    }
+    return best;
+}
+
+int main() {
+    const size_t count = 3840 * 2160;
+    std::vector<Vec3f>   pixels(count);
+    std::vector<uint8_t> rgb(count * 3);
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> radiance(0, 2);
+    for (auto& p : pixels) {
+        p = Vec3f{radiance(gen), radiance(gen), radiance(gen)};
+    }
+
+    std::cout << "[INFO] ToneMapScalar: "
+              << Best([&]() { ToneMapScalar(pixels.data(), count, 2.0, rgb.data()); }) << " ms"
+              << std::endl;
+    std::cout << "[INFO] ToneMap: "
+              << Best([&]() { ToneMap(pixels.data(), count, 2.0, rgb.data()); }) << " ms" << std::endl;
+
+    Material material;
+    material.Ke = {0.8, 0.5, 0.2};
+    Scene scene{{std::make_shared<Sphere>(Vec3f{0, 0, -2}, 10., material)}, {}, {}};
+
+    CameraOptions camera(3840, 2160);
+    RenderOptions options{1};
+    std::cout << "[INFO] 4K frame: " << Best([&]() { Render(scene, camera, options); }) << " ms"
+              << std::endl;
+    return 0;
+}
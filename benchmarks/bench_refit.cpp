@@ -0,0 +1,56 @@
+#include <iostream>
+#include <random>
+#include <chrono>
+
+#include <raytracer/geometry.hpp>
+
+// NB: Per frame update cost of a scene where a few spheres move,
+// refit versus building the scene from scratch.
+
+static constexpr int kNumSpheres = 100000;
+static constexpr int kNumMoved   = 10;
+static constexpr int kNumFrames  = 100;
+
+int main() {
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> pos(-100, 100);
+    std::uniform_real_distribution<double> step(-0.5, 0.5);
+    std::uniform_int_distribution<int>     pick(0, kNumSpheres - 1);
+
+    std::vector<Vec3f> centers;
+    Objects objects;
+    for (int i = 0; i < kNumSpheres; ++i) {
+        centers.push_back({pos(gen), pos(gen), pos(gen)});
+        objects.push_back(std::make_shared<Sphere>(centers.back(), 0.5));
+    }
+    Objects copy = objects;
+    Scene scene{std::move(copy), {}, {}};
+
+    using namespace std::chrono;
+    double refit = 0, rebuild = 0;
+    for (int frame = 0; frame < kNumFrames; ++frame) {
+        std::vector<int> moved;
+        for (int k = 0; k < kNumMoved; ++k) {
+            int i = pick(gen);
+            centers[i] = centers[i] + Vec3f{step(gen), step(gen), step(gen)};
+            std::static_pointer_cast<Sphere>(objects[i])->SetGeometry(centers[i], 0.5);
+            moved.push_back(i);
+        }
+
+        auto start = high_resolution_clock::now();
+        scene.Refit(moved);
+        auto end   = high_resolution_clock::now();
+        refit += duration<double, std::milli>(end - start).count();
+
+        Objects fresh = objects;
+        start = high_resolution_clock::now();
+        Scene rebuilt{std::move(fresh), {}, {}};
+        end   = high_resolution_clock::now();
+        rebuild += duration<double, std::milli>(end - start).count();
+    }
+
+    std::cout << "[INFO] Refit:   " << refit   / kNumFrames << " ms/frame" << std::endl;
+    std::cout << "[INFO] Rebuild: " << rebuild / kNumFrames << " ms/frame" << std::endl;
+    std::cout << "[INFO] Degradation: " << scene.GetBVH().GetDegradation() << std::endl;
+    return 0;
+}
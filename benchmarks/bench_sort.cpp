@@ -0,0 +1,76 @@
+#include <iostream>
+#include <random>
+#include <chrono>
+
+#include <raytracer/render.hpp>
+
+// NB: RenderWavefront with and without ray sorting on a mirror-heavy scene:
+// random mirror spheres over a field of small triangles, so secondary and
+// shadow rays are incoherent and the scene BVH is deep.
+
+static constexpr int kNumSpheres   = 1000;
+static constexpr int kNumTriangles = 200000;
+
+static Scene MakeScene() {
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> pos(-10, 10);
+    std::uniform_real_distribution<double> offset(-0.2, 0.2);
+
+    auto buffers = std::make_shared<MeshBuffers>();
+    MeshIndices indices;
+    for (int tri = 0; tri < kNumTriangles; ++tri) {
+        Vec3f c{pos(gen), pos(gen) - 12, pos(gen)};
+        for (int k = 0; k < 3; ++k) {
+            indices.v.push_back(static_cast<int>(buffers->px.size()));
+            buffers->px.push_back(c.x + offset(gen));
+            buffers->py.push_back(c.y + offset(gen));
+            buffers->pz.push_back(c.z + offset(gen));
+        }
+    }
+
+    Material diffuse;
+    diffuse.Kd = {0.6, 0.6, 0.6};
+    Objects objects{std::make_shared<TriangleMesh>(buffers, std::move(indices), diffuse)};
+
+    Material mirror;
+    mirror.Kd    = {0.1, 0.1, 0.1};
+    mirror.Ks    = {0.8, 0.8, 0.8};
+    mirror.Ns    = 50;
+    mirror.illum = 3;
+    for (int i = 0; i < kNumSpheres; ++i) {
+        objects.push_back(std::make_shared<Sphere>(Vec3f{pos(gen), pos(gen), pos(gen)}, 0.6, mirror));
+    }
+
+    Scene scene{std::move(objects), {}, {}};
+    scene.AddLight(Light{{0, 20, 20}, {1, 1, 1}});
+    scene.AddLight(Light{{20, 0, 20}, {0.5, 0.5, 0.5}});
+    return scene;
+}
+
+int main() {
+    const auto scene = MakeScene();
+
+    CameraOptions camera(500, 500);
+    camera.look_from = {0, 4, 25};
+    camera.look_to   = {0, -2, 0};
+
+    for (bool sort : {false, true}) {
+        RenderOptions options{6};
+        options.sort_rays = sort;
+
+        RenderStats stats;
+        using namespace std::chrono;
+        auto start = high_resolution_clock::now();
+        RenderWavefront(scene, camera, options, &stats);
+        auto end   = high_resolution_clock::now();
+
+        const auto& w = stats.wavefront;
+        std::cout << "[INFO] " << (sort ? "sorted" : "unsorted") << ": "
+                  << duration<double, std::milli>(end - start).count() << " ms (sort " << w.sort_ms
+                  << ", intersect " << w.intersect_ms << ", shadow " << w.shadow_ms << "), "
+                  << static_cast<double>(w.nodes) / w.rays << " nodes per ray, "
+                  << static_cast<double>(w.shadow_nodes) / w.shadow_rays << " per shadow ray"
+                  << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include <iostream>
+#include <chrono>
+
+#include <raytracer/render.hpp>
+
+// NB: 3D grid of glass and mirror spheres inside a mirror sphere. Every hit
+// spawns a reflected and a refracted branch, even if the latter has zero
+// weight for mirrors, so without culling paths grow as 2^depth.
+
+static constexpr int kGridSize = 6;
+
+static Scene MakeScene() {
+    Material glass;
+    glass.Ks    = {0.3, 0.3, 0.3};
+    glass.Ns    = 50;
+    glass.Tr    = 0.9;
+    glass.Ni    = 1.5;
+    glass.illum = 4;
+
+    Material mirror;
+    mirror.Kd    = {0.1, 0.1, 0.1};
+    mirror.Ks    = {0.8, 0.8, 0.8};
+    mirror.Ns    = 100;
+    mirror.illum = 3;
+
+    Objects objects;
+    for (int i = 0; i < kGridSize; ++i) {
+        for (int j = 0; j < kGridSize; ++j) {
+            for (int k = 0; k < kGridSize; ++k) {
+                objects.push_back(std::make_shared<Sphere>(
+                    Vec3f{2.2 * i - 5.5, 2.2 * j - 5.5, -2.2 * k - 6}, 1.,
+                    (i + j + k) % 2 ? mirror : glass));
+            }
+        }
+    }
+    objects.push_back(std::make_shared<Sphere>(Vec3f{0, 0, 0}, 30., mirror));
+
+    Scene scene{std::move(objects), {}, {}};
+    scene.AddLight(Light{{5, 5, 0}, {1, 1, 1}});
+    return scene;
+}
+
+int main() {
+    const auto scene = MakeScene();
+    CameraOptions camera(200, 200);
+
+    struct Config {
+        double min_throughput;
+        bool   russian_roulette;
+    };
+
+    for (int depth : {4, 8, 12}) {
+        for (auto config : {Config{0.0, false}, Config{1e-2, false}, Config{1e-2, true}}) {
+            RenderOptions options{depth};
+            options.min_throughput   = config.min_throughput;
+            options.russian_roulette = config.russian_roulette;
+
+            using namespace std::chrono;
+            auto start = high_resolution_clock::now();
+            Render(scene, camera, options);
+            auto end   = high_resolution_clock::now();
+
+            std::cout << "[INFO] depth " << depth << ", min throughput " << config.min_throughput
+                      << (config.russian_roulette ? ", roulette: " : ": ")
+                      << duration<double, std::milli>(end - start).count() << " ms" << std::endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,76 @@
+#include <iostream>
+#include <random>
+#include <chrono>
+
+#include <raytracer/geometry.hpp>
+
+// NB: Cost of a single ray-triangle test when the edges are rebuilt
+// from the vertex buffers on every call versus precomputed records.
+
+static constexpr int kNumTriangles = 4096;
+static constexpr int kNumRays      = 2048;
+
+template <typename F>
+static double Measure(F&& f) {
+    using namespace std::chrono;
+    auto start = high_resolution_clock::now();
+    f();
+    auto end   = high_resolution_clock::now();
+    return duration<double, std::nano>(end - start).count() /
+           (static_cast<double>(kNumTriangles) * kNumRays);
+}
+
+int main() {
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> pos(-1, 1);
+
+    MeshBuffers buffers;
+    std::vector<int> indices;
+    for (int i = 0; i < kNumTriangles * 3; ++i) {
+        buffers.px.push_back(pos(gen));
+        buffers.py.push_back(pos(gen));
+        buffers.pz.push_back(pos(gen) - 3);
+        indices.push_back(i);
+    }
+
+    std::vector<Ray> rays;
+    for (int i = 0; i < kNumRays; ++i) {
+        rays.push_back(Ray{{0, 0, 0}, Vec3f{pos(gen), pos(gen), -1}.normalize()});
+    }
+
+    std::vector<TriangleRecord> records;
+    for (int tri = 0; tri < kNumTriangles; ++tri) {
+        auto v0 = buffers.GetPosition(indices[3 * tri]);
+        auto v1 = buffers.GetPosition(indices[3 * tri + 1]);
+        auto v2 = buffers.GetPosition(indices[3 * tri + 2]);
+        records.push_back(TriangleRecord{v0, v1 - v0, v2 - v0});
+    }
+
+    int hits_before = 0, hits_after = 0;
+    double t, u, v;
+
+    double before = Measure([&]() {
+        for (const auto& ray : rays) {
+            for (int tri = 0; tri < kNumTriangles; ++tri) {
+                auto v0 = buffers.GetPosition(indices[3 * tri]);
+                auto v1 = buffers.GetPosition(indices[3 * tri + 1]);
+                auto v2 = buffers.GetPosition(indices[3 * tri + 2]);
+                hits_before += IntersectTriangle(TriangleRecord{v0, v1 - v0, v2 - v0},
+                                                 ray, &t, &u, &v);
+            }
+        }
+    });
+
+    double after = Measure([&]() {
+        for (const auto& ray : rays) {
+            for (const auto& record : records) {
+                hits_after += IntersectTriangle(record, ray, &t, &u, &v);
+            }
+        }
+    });
+
+    std::cout << "[INFO] Hits: " << hits_before << " / " << hits_after << std::endl;
+    std::cout << "[INFO] Rebuilt edges:       " << before << " ns/test" << std::endl;
+    std::cout << "[INFO] Precomputed records: " << after  << " ns/test" << std::endl;
+    return 0;
+}
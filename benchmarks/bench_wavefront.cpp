@@ -0,0 +1,98 @@
+#include <iostream>
+#include <random>
+#include <chrono>
+#include <string>
+
+#include <raytracer/render.hpp>
+#include <raytracer/parser.hpp>
+
+// NB: Render against RenderWavefront on the given *.obj scenes and on a
+// procedural field of small glass and diffuse spheres over a large mesh.
+
+static constexpr int kNumSpheres   = 2000;
+static constexpr int kNumTriangles = 200000;
+
+static Scene MakeProceduralScene() {
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> pos(-10, 10);
+    std::uniform_real_distribution<double> offset(-0.2, 0.2);
+    std::uniform_real_distribution<double> color(0.1, 0.9);
+
+    auto buffers = std::make_shared<MeshBuffers>();
+    MeshIndices indices;
+    for (int tri = 0; tri < kNumTriangles; ++tri) {
+        Vec3f c{pos(gen), pos(gen) - 12, pos(gen)};
+        for (int k = 0; k < 3; ++k) {
+            indices.v.push_back(static_cast<int>(buffers->px.size()));
+            buffers->px.push_back(c.x + offset(gen));
+            buffers->py.push_back(c.y + offset(gen));
+            buffers->pz.push_back(c.z + offset(gen));
+        }
+    }
+
+    Material diffuse;
+    diffuse.Kd = {0.6, 0.6, 0.6};
+    Objects objects{std::make_shared<TriangleMesh>(buffers, std::move(indices), diffuse)};
+
+    for (int i = 0; i < kNumSpheres; ++i) {
+        Material material;
+        material.Kd = {color(gen), color(gen), color(gen)};
+        material.Ks = {0.2, 0.2, 0.2};
+        material.Ns = 20;
+        if (i % 4 == 0) {
+            material.Tr    = 0.8;
+            material.Ni    = 1.5;
+            material.illum = 4;
+        }
+        objects.push_back(std::make_shared<Sphere>(Vec3f{pos(gen), pos(gen), pos(gen)}, 0.4, material));
+    }
+
+    Scene scene{std::move(objects), {}, {}};
+    scene.AddLight(Light{{0, 20, 20}, {1, 1, 1}});
+    return scene;
+}
+
+static void Run(const std::string& name, Scene& scene) {
+    const auto& bounds = scene.GetBVH().GetNodes()[0].bounds;
+    const Vec3f c = (bounds.lo + bounds.hi) * 0.5;
+    const double d = (bounds.hi - bounds.lo).length();
+
+    if (scene.GetLights().empty()) {
+        scene.AddLight(Light{{c.x + d, c.y + d, c.z + d}, {1, 1, 1}});
+    }
+
+    CameraOptions camera(500, 500);
+    camera.look_from = {c.x + d * 0.7, c.y + d * 0.7, c.z + d * 0.7};
+    camera.look_to   = {c.x, c.y, c.z};
+    RenderOptions options{4};
+
+    using namespace std::chrono;
+    auto start = high_resolution_clock::now();
+    Render(scene, camera, options);
+    auto end   = high_resolution_clock::now();
+    const double render_ms = duration<double, std::milli>(end - start).count();
+
+    RenderStats stats;
+    start = high_resolution_clock::now();
+    RenderWavefront(scene, camera, options, &stats);
+    end   = high_resolution_clock::now();
+    const double wavefront_ms = duration<double, std::milli>(end - start).count();
+
+    const auto& w = stats.wavefront;
+    std::cout << "[INFO] " << name << ": Render " << render_ms << " ms, RenderWavefront "
+              << wavefront_ms << " ms (camera " << w.camera_ms << ", intersect " << w.intersect_ms
+              << ", shade " << w.shade_ms << ", shadow " << w.shadow_ms << ", emit " << w.emit_ms
+              << "), " << w.rays << " rays, " << w.shadow_rays << " shadow rays, "
+              << w.waves << " waves" << std::endl;
+}
+
+int main(int argc, const char** argv) {
+    for (int i = 1; i < argc; ++i) {
+        auto scene = Parse(argv[i]);
+        Run(argv[i], scene);
+    }
+
+    auto scene = MakeProceduralScene();
+    Run("procedural", scene);
+    return 0;
+}
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <string>
+#include <unordered_map>
+
 #include <raytracer/geometry.hpp>
 #include <raytracer/datatypes.hpp>
 
@@ -14,10 +17,19 @@ public:
     SceneBuilder& Add(const Light&           l);
     SceneBuilder& Add(const SphereElement&   s);
     SceneBuilder& Add(const FaceElement&     f);
+    // NB: Instances share the prototype geometry instead of copying it.
+    SceneBuilder& Add(const Instance::Ptr&   instance);
 
     Scene Finalize();
 
 private:
+    // NB: Faces sharing a material are gathered into one mesh,
+    // meshes are created on Finalize when all vertices are known.
+    struct Mesh {
+        Material    material;
+        MeshIndices indices;
+    };
+
     struct State {
         Material                     material;
         std::vector<GeometricVertex> geom_vertices;
@@ -25,6 +37,9 @@ private:
         std::vector<VertexNormal>    vertex_normals;
         std::vector<Light>           lights;
         std::vector<Object::Ptr>     objects;
+        std::vector<Mesh>            meshes;
+        // NB: Index in meshes by material name.
+        std::unordered_map<std::string, size_t> mesh_index;
     };
 
     std::shared_ptr<State> _state;
@@ -0,0 +1,364 @@
+#pragma once
+
+#include <vector>
+#include <limits>
+#include <utility>
+#include <cstdint>
+#include <bitset>
+#include <algorithm>
+
+#include "datatypes.hpp"
+
+// NB: Axis aligned bounding box, empty by default.
+struct AABB {
+    AABB() = default;
+    AABB(const Vec3f& lo, const Vec3f& hi);
+
+    void   Extend(const Vec3f& p);
+    void   Extend(const AABB& box);
+    bool   IsEmpty()     const;
+    Vec3f  Centroid()    const;
+    Vec3f  Extent()      const;
+    double SurfaceArea() const;
+
+    // NB: Slab test, returns entry distance through tnear.
+    // inv_dir is the component-wise inverse of the ray direction.
+    bool Intersect(const Vec3f& orig,
+                   const Vec3f& inv_dir,
+                   double       tmax,
+                   double*      tnear) const;
+
+    Vec3f lo{ std::numeric_limits<double>::max(),
+              std::numeric_limits<double>::max(),
+              std::numeric_limits<double>::max()};
+    Vec3f hi{-std::numeric_limits<double>::max(),
+             -std::numeric_limits<double>::max(),
+             -std::numeric_limits<double>::max()};
+};
+
+// NB: Up to 64 coherent rays in structure-of-arrays layout, e.g. primary
+// rays of a pixel block. Lane i takes part in a query when bit i of the
+// mask is set.
+struct RayPacket {
+    static constexpr int kMaxSize = 64;
+    using Mask = uint64_t;
+
+    void  Set(int lane, const Vec3f& orig, const Vec3f& dir);
+    Vec3f GetOrig(int lane) const;
+    Vec3f GetDir (int lane) const;
+    Mask  GetMask()         const;
+
+    int size = 0;
+    alignas(32) double ox[kMaxSize], oy[kMaxSize], oz[kMaxSize];
+    alignas(32) double dx[kMaxSize], dy[kMaxSize], dz[kMaxSize];
+    // NB: Component-wise inverse of the directions.
+    alignas(32) double ix[kMaxSize], iy[kMaxSize], iz[kMaxSize];
+};
+
+inline void RayPacket::Set(int lane, const Vec3f& orig, const Vec3f& dir) {
+    ox[lane] = orig.x; oy[lane] = orig.y; oz[lane] = orig.z;
+    dx[lane] = dir.x;  dy[lane] = dir.y;  dz[lane] = dir.z;
+    ix[lane] = 1 / dir.x; iy[lane] = 1 / dir.y; iz[lane] = 1 / dir.z;
+}
+
+inline Vec3f RayPacket::GetOrig(int lane) const {
+    return {ox[lane], oy[lane], oz[lane]};
+}
+
+inline Vec3f RayPacket::GetDir(int lane) const {
+    return {dx[lane], dy[lane], dz[lane]};
+}
+
+inline RayPacket::Mask RayPacket::GetMask() const {
+    return size == kMaxSize ? ~Mask{0} : ((Mask{1} << size) - 1);
+}
+
+// NB: Nodes visited by the single ray traversals of the calling thread,
+// for profiling. Updated once per traversal.
+struct TraversalCounters {
+    int64_t nodes = 0;
+};
+
+TraversalCounters& GetTraversalCounters();
+
+// NB: Binary bounding volume hierarchy built with the surface area heuristic.
+// Primitives are referenced by their index in the bounds array passed to the
+// constructor, so the same tree serves any kind of primitive.
+class BVH {
+public:
+    struct Node {
+        AABB bounds;
+        // NB: Index of the right child for inner nodes (the left child
+        // always follows its parent), first entry in indices for leaves.
+        int  offset;
+        // NB: Number of primitives in the leaf, 0 for inner nodes.
+        int  count;
+    };
+
+    BVH() = default;
+    explicit BVH(const std::vector<AABB>& bounds);
+
+    const std::vector<Node>& GetNodes()   const;
+    const std::vector<int>&  GetIndices() const;
+    AABB                     GetBounds()  const;
+
+    // NB: Makes leaves reference primitives by their position in leaf
+    // order and returns the permutation the caller has to apply to them.
+    std::vector<int> Linearize();
+
+    // NB: Refits the leaves of the given primitives and their ancestors
+    // bottom-up after the primitive boxes have changed, other subtrees are
+    // not visited. bounds holds the boxes of all primitives. Returns the
+    // nodes whose box has changed.
+    std::vector<int> Refit(const std::vector<int>&  primitives,
+                           const std::vector<AABB>& bounds);
+
+    // NB: Expected cost of a ray query by the surface area heuristic,
+    // updated by Refit.
+    double GetCost()        const;
+    // NB: Cost relative to the one right after the build.
+    double GetDegradation() const;
+
+    // NB: Owners rebuild a refitted tree once its degradation exceeds this.
+    static constexpr double kRebuildThreshold = 1.5;
+
+    // NB: Visits the leaves front-to-back and calls f(primitive, tmax)
+    // for every primitive whose leaf is entered before tmax. f may shrink
+    // tmax to prune the rest of traversal and returns true to stop it.
+    template <typename F>
+    void Traverse(const Vec3f& orig, const Vec3f& dir, double tmax, F&& f) const;
+
+    // NB: Same as Traverse, but calls f(node, tmax) once per entered leaf.
+    // Traversal starts at root, which allows to continue inside a subtree.
+    template <typename F>
+    void TraverseLeaves(const Vec3f& orig, const Vec3f& dir, double tmax, F&& f,
+                        int root = 0) const;
+
+    // NB: Traverses the tree with all active lanes of the packet at once and
+    // calls f(node, mask, tmax) for every leaf entered by the lanes in mask.
+    // f updates tmax[lane] of the lanes that found a closer hit. Nodes are
+    // culled with interval arithmetic over the whole packet first, then
+    // per lane. Subtrees reached by a few lanes only are finished with
+    // single ray traversal.
+    template <typename F>
+    void TraversePacket(const RayPacket& packet, RayPacket::Mask active, double* tmax,
+                        F&& f) const;
+
+    // NB: Deeper subtrees are collapsed into leaves, which bounds
+    // the traversal stack.
+    static constexpr int kMaxDepth = 64;
+
+private:
+    int Build(const std::vector<AABB>&  bounds,
+              const std::vector<Vec3f>& centroids,
+              int                       begin,
+              int                       end,
+              int                       depth);
+    // NB: Fills parents of nodes and leaves of primitives.
+    void Link();
+
+    std::vector<Node> _nodes;
+    std::vector<int>  _indices;
+    std::vector<int>  _parents;
+    std::vector<int>  _leaves;
+    // NB: Sum of surface areas weighted by the node costs.
+    double            _weighted_area = 0.0;
+    double            _build_cost    = 0.0;
+};
+
+template <typename F>
+void BVH::Traverse(const Vec3f& orig, const Vec3f& dir, double tmax, F&& f) const {
+    TraverseLeaves(orig, dir, tmax, [&](int node, double& tlimit) {
+        const auto& leaf = _nodes[node];
+        for (int i = leaf.offset; i < leaf.offset + leaf.count; ++i) {
+            if (f(_indices[i], tlimit)) {
+                return true;
+            }
+        }
+        return false;
+    });
+}
+
+template <typename F>
+void BVH::TraverseLeaves(const Vec3f& orig, const Vec3f& dir, double tmax, F&& f,
+                         int root) const {
+    if (_nodes.empty()) {
+        return;
+    }
+
+    const Vec3f inv_dir{1 / dir.x, 1 / dir.y, 1 / dir.z};
+
+    double tnear = 0;
+    if (!_nodes[root].bounds.Intersect(orig, inv_dir, tmax, &tnear)) {
+        return;
+    }
+
+    struct Entry {
+        int    node;
+        double tnear;
+    };
+
+    Entry stack[kMaxDepth + 1];
+    int top = 0;
+    stack[top++] = Entry{root, tnear};
+    int64_t visited = 0;
+
+    while (top > 0) {
+        const auto entry = stack[--top];
+        // NB: Closest hit might have been found since the node was pushed.
+        if (entry.tnear > tmax) {
+            continue;
+        }
+        ++visited;
+
+        const auto& node = _nodes[entry.node];
+        if (node.count > 0) {
+            if (f(entry.node, tmax)) {
+                break;
+            }
+            continue;
+        }
+
+        int    left  = entry.node + 1;
+        int    right = node.offset;
+        double tleft = 0, tright = 0;
+        bool   hit_left  = _nodes[left ].bounds.Intersect(orig, inv_dir, tmax, &tleft);
+        bool   hit_right = _nodes[right].bounds.Intersect(orig, inv_dir, tmax, &tright);
+
+        if (hit_left && hit_right) {
+            // NB: Push the far child first to visit the near one next.
+            if (tleft > tright) {
+                std::swap(left, right);
+                std::swap(tleft, tright);
+            }
+            stack[top++] = Entry{right, tright};
+            stack[top++] = Entry{left,  tleft};
+        } else if (hit_left) {
+            stack[top++] = Entry{left, tleft};
+        } else if (hit_right) {
+            stack[top++] = Entry{right, tright};
+        }
+    }
+    GetTraversalCounters().nodes += visited;
+}
+
+// NB: Conservative bounds of the slab distances of every ray in a packet.
+struct PacketInterval {
+    bool  valid = true;
+    Vec3f orig_lo, orig_hi;
+    Vec3f inv_lo,  inv_hi;
+};
+
+PacketInterval MakePacketInterval(const RayPacket& packet, RayPacket::Mask active);
+
+// NB: True if no ray within the interval can enter the box before tmax.
+bool IsCulled(const PacketInterval& interval, const AABB& box, double tmax);
+
+// NB: Sets bit i for every lane in active whose ray enters the box before
+// tmax[i], the smallest entry distance is returned through tnear.
+RayPacket::Mask IntersectLanes(const AABB& box, const RayPacket& packet,
+                               RayPacket::Mask active, const double* tmax,
+                               double* tnear);
+
+template <typename F>
+void BVH::TraversePacket(const RayPacket& packet, RayPacket::Mask active, double* tmax,
+                         F&& f) const {
+    if (_nodes.empty() || active == 0) {
+        return;
+    }
+
+    const auto interval = MakePacketInterval(packet, active);
+    // NB: Below this number of lanes a subtree is traversed ray by ray.
+    const size_t min_lanes = std::max(2, packet.size / 4);
+
+    struct Entry {
+        int             node;
+        RayPacket::Mask mask;
+        double          tnear;
+    };
+
+    auto max_tmax = [&](RayPacket::Mask mask) {
+        double t = -std::numeric_limits<double>::max();
+        for (int lane = 0; lane < packet.size; ++lane) {
+            if ((mask >> lane & 1) && tmax[lane] > t) {
+                t = tmax[lane];
+            }
+        }
+        return t;
+    };
+
+    auto visit = [&](int node, RayPacket::Mask mask, double* tnear) -> RayPacket::Mask {
+        const auto& box = _nodes[node].bounds;
+        if (interval.valid && IsCulled(interval, box, max_tmax(mask))) {
+            return 0;
+        }
+        return IntersectLanes(box, packet, mask, tmax, tnear);
+    };
+
+    Entry stack[kMaxDepth + 1];
+    int top = 0;
+
+    double tnear = 0;
+    auto mask = visit(0, active, &tnear);
+    if (mask == 0) {
+        return;
+    }
+    stack[top++] = Entry{0, mask, tnear};
+
+    while (top > 0) {
+        auto entry = stack[--top];
+        // NB: Drop lanes which have found a hit closer than the node.
+        for (int lane = 0; lane < packet.size; ++lane) {
+            if ((entry.mask >> lane & 1) && entry.tnear > tmax[lane]) {
+                entry.mask &= ~(RayPacket::Mask{1} << lane);
+            }
+        }
+        if (entry.mask == 0) {
+            continue;
+        }
+
+        const auto& node = _nodes[entry.node];
+        if (node.count > 0) {
+            f(entry.node, entry.mask, tmax);
+            continue;
+        }
+
+        // NB: The packet has diverged, finish the subtree with single rays.
+        if (std::bitset<RayPacket::kMaxSize>(entry.mask).count() < min_lanes) {
+            for (int lane = 0; lane < packet.size; ++lane) {
+                if (!(entry.mask >> lane & 1)) {
+                    continue;
+                }
+                const auto bit = RayPacket::Mask{1} << lane;
+                TraverseLeaves(packet.GetOrig(lane), packet.GetDir(lane), tmax[lane],
+                        [&](int leaf, double& tlimit) {
+                            f(leaf, bit, tmax);
+                            tlimit = tmax[lane];
+                            return false;
+                        }, entry.node);
+            }
+            continue;
+        }
+
+        int    left  = entry.node + 1;
+        int    right = node.offset;
+        double tleft = 0, tright = 0;
+        auto   mask_left  = visit(left,  entry.mask, &tleft);
+        auto   mask_right = visit(right, entry.mask, &tright);
+
+        if (mask_left && mask_right) {
+            // NB: Push the far child first to visit the near one next.
+            if (tleft > tright) {
+                std::swap(left, right);
+                std::swap(tleft, tright);
+                std::swap(mask_left, mask_right);
+            }
+            stack[top++] = Entry{right, mask_right, tright};
+            stack[top++] = Entry{left,  mask_left,  tleft};
+        } else if (mask_left) {
+            stack[top++] = Entry{left, mask_left, tleft};
+        } else if (mask_right) {
+            stack[top++] = Entry{right, mask_right, tright};
+        }
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "datatypes.hpp"
+#include "geometry.hpp"
+#include "options.hpp"
+
+// NB: State of a tiled render: which tiles of the row-major tile grid are
+// finished, the radiance of those is stored next to it.
+struct Checkpoint {
+    int               width       = 0;
+    int               height      = 0;
+    int               tile_size   = 0;
+    // NB: Hash of the options the render depends on.
+    uint64_t          fingerprint = 0;
+    std::vector<char> done;
+};
+
+// NB: Writes the header, the tile flags and the radiance of the finished
+// tiles only, as doubles in tile order. The file is written next to path
+// and renamed over it, so a crash never leaves a partial checkpoint.
+void WriteCheckpoint(const std::string& path, const Checkpoint& checkpoint, const Matf& radiance);
+
+// NB: Returns false if there is no file at path, fills the radiance of the
+// finished tiles otherwise. radiance must have the size of the checkpoint.
+bool ReadCheckpoint(const std::string& path, Checkpoint* checkpoint, Matf* radiance);
+
+// NB: Hash of the scene and the options the radiance of a render depends on.
+uint64_t CheckpointFingerprint(const Scene&         scene,
+                               const CameraOptions& camera_options,
+                               const RenderOptions& render_options);
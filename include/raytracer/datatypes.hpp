@@ -1,6 +1,8 @@
 #pragma once
 
 #include <array>
+#include <new>
+#include <cstddef>
 #include <vector>
 #include <ostream>
 
@@ -67,19 +69,87 @@ inline std::ostream& operator<<(std::ostream& os, Vec3f vec) {
     return os;
 }
 
+// NB: Affine transform, the top three rows of a 4x4 matrix.
+struct Transform {
+    static Transform Identity();
+    static Transform Translate(const Vec3f& t);
+    static Transform Scale    (const Vec3f& s);
+    // NB: Counterclockwise rotation around the axis by angle in radians.
+    static Transform Rotate   (const Vec3f& axis, double angle);
+
+    // NB: Applies rhs first.
+    Transform operator*(const Transform& rhs) const;
+    Transform Inverse()                       const;
+
+    Vec3f Point (const Vec3f& p) const;
+    Vec3f Vector(const Vec3f& v) const;
+    // NB: Multiplies by the transposed linear part, normals are
+    // transformed this way by the inverse transform.
+    Vec3f TransposedVector(const Vec3f& v) const;
+
+    double m[3][4];
+};
+
+// NB: Allocates with the given alignment, for std::vector.
+template <typename T, size_t Align>
+struct AlignedAllocator {
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = AlignedAllocator<U, Align>;
+    };
+
+    AlignedAllocator() = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, Align>&) {
+    }
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Align)));
+    }
+    void deallocate(T* p, size_t) {
+        ::operator delete(p, std::align_val_t(Align));
+    }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U, Align>&) const {
+        return true;
+    }
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U, Align>&) const {
+        return false;
+    }
+};
+
+// NB: Row-major HDR framebuffer in a single allocation. Rows start on
+// cache lines, so tiles whose width is a multiple of 8 pixels never share
+// one between threads.
 class Matf {
 public:
+    static constexpr size_t kAlignment = 64;
+
     Matf() = default;
     Matf(size_t w, size_t h);
 
     size_t GetW() const;
     size_t GetH() const;
+    // NB: Distance between rows in pixels.
+    size_t GetStride() const;
+
+          Vec3f* Row(size_t y);
+    const Vec3f* Row(size_t y) const;
 
-          std::vector<Vec3f>& operator[](int i);
-    const std::vector<Vec3f>& operator[](int i) const;
+    Vec3f& operator()(size_t x, size_t y) {
+        return data[y * stride + x];
+    }
+    const Vec3f& operator()(size_t x, size_t y) const {
+        return data[y * stride + x];
+    }
 
 private:
     size_t width  = 0;
     size_t height = 0;
-    std::vector<std::vector<Vec3f>> data;
+    size_t stride = 0;
+    std::vector<Vec3f, AlignedAllocator<Vec3f, kAlignment>> data;
 };
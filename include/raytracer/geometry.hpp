@@ -3,12 +3,15 @@
 #include <optional>
 #include <vector>
 #include <memory>
+#include <limits>
 
 #include <cmath>
 
 #include "datatypes.hpp"
 #include "options.hpp"
 #include "image.hpp"
+#include "bvh.hpp"
+#include "wide_bvh.hpp"
 
 // NB: http://paulbourke.net/dataformats/obj/
 
@@ -61,12 +64,6 @@ struct SphereElement {
     double radius;
 };
 
-struct ExplicitNormals {
-    Vec3f v0n;
-    Vec3f v1n;
-    Vec3f v2n;
-};
-
 struct Ray {
     Vec3f at(double t) const;
 
@@ -106,6 +103,25 @@ struct HitInfo {
     std::optional<Vec3f> texture_Kd;
     std::optional<Vec3f> texture_Ka;
     std::optional<Vec3f> texture_bump;
+
+    const Material* material = nullptr;
+};
+
+class Object;
+
+constexpr double kInfinity = std::numeric_limits<double>::max();
+
+// NB: Lightweight record produced during traversal, shading
+// attributes are evaluated later by Object::GetHitInfo.
+struct Intersection {
+    double distance;
+    // NB: Barycentric coordinates of the hit, unused by spheres.
+    double u         = 0.0;
+    double v         = 0.0;
+    int    primitive = 0;
+
+    // NB: Filled by Scene::Intersect.
+    const Object* object = nullptr;
 };
 
 class Object {
@@ -116,7 +132,24 @@ public:
     Object() = default;
     Object(const Material m = {});
 
-    virtual std::optional<HitInfo> intersect(const Ray& ray) = 0;
+    // NB: Closest hit in front of the ray that is nearer than tmax.
+    virtual std::optional<Intersection> intersect(const Ray& ray, double tmax = kInfinity) = 0;
+    // NB: Packet version, intersects every active lane that is nearer than
+    // tmax[lane], updates tmax and hits of closer lanes and returns their mask.
+    // By default the lanes are intersected one by one.
+    virtual RayPacket::Mask intersect(const RayPacket& packet,
+                                      RayPacket::Mask  active,
+                                      double*          tmax,
+                                      Intersection*    hits);
+    virtual HitInfo GetHitInfo(const Ray& ray, const Intersection& isect) const = 0;
+    // NB: Any hit closer than tmax, no shading information is computed.
+    virtual bool occluded(const Ray& ray, double tmax) = 0;
+    virtual AABB GetBounds() const = 0;
+    // NB: Called by Scene once the geometry is final,
+    // builds per-object acceleration data.
+    virtual void Commit() {}
+    // NB: Selects the tree used by single ray queries, called after Commit.
+    virtual void SetBVHLayout(BVHLayout /*layout*/) {}
     const Material& GetMaterial() const;
 
 protected:
@@ -128,31 +161,147 @@ class Sphere : public Object {
 public:
     Sphere(Vec3f center, double radius, const Material m = {});
 
-    std::optional<HitInfo> intersect(const Ray& ray) override;
+    using Object::intersect;
+    std::optional<Intersection> intersect(const Ray& ray, double tmax = kInfinity) override;
+    HitInfo GetHitInfo(const Ray& ray, const Intersection& isect) const override;
+    bool occluded(const Ray& ray, double tmax) override;
+    AABB GetBounds() const override;
+
+    // NB: Scene::Refit has to be called afterwards.
+    void SetGeometry(const Vec3f& center, double radius);
 
 private:
     Vec3f c;
     double r;
 };
 
-class Triangle : public Object {
+// NB: Vertex attributes in structure-of-arrays layout,
+// shared by every mesh built from the same file.
+struct MeshBuffers {
+    Vec3f GetPosition(int i) const;
+    Vec3f GetNormal  (int i) const;
+    Vec3f GetTexture (int i) const;
+
+    std::vector<double> px, py, pz;
+    // NB: Normalized at build time.
+    std::vector<double> nx, ny, nz;
+    std::vector<double> tu, tv;
+};
+
+// NB: Three entries per triangle. vt and vn are either empty when no
+// triangle of the mesh has them or hold -1 for the triangles without.
+struct MeshIndices {
+    std::vector<int> v;
+    std::vector<int> vt;
+    std::vector<int> vn;
+};
+
+// NB: Ray independent part of Moller-Trumbore, precomputed per triangle.
+struct TriangleRecord {
+    Vec3f v0;
+    // NB: Edges v1 - v0 and v2 - v0.
+    Vec3f e1;
+    Vec3f e2;
+};
+
+// NB: Up to four triangles of a BVH leaf in structure-of-arrays lanes.
+// Unused lanes have zero edges and tri = -1, so they never report a hit.
+struct alignas(32) TrianglePacket {
+    static constexpr int kWidth = 4;
+
+    double v0x[kWidth], v0y[kWidth], v0z[kWidth];
+    double e1x[kWidth], e1y[kWidth], e1z[kWidth];
+    double e2x[kWidth], e2y[kWidth], e2z[kWidth];
+    int    tri[kWidth];
+};
+
+// NB: Bump mapping basis built from the texture coordinates.
+struct TangentFrame {
+    Vec3f tangent;
+    Vec3f bitangent;
+};
+
+class TriangleMesh : public Object {
 public:
-    template <typename T>
-    using OA = std::optional<std::array<T, 3>>;
+    TriangleMesh(std::shared_ptr<const MeshBuffers> buffers,
+                 MeshIndices&&                      indices,
+                 const Material&                    m = {});
+
+    std::optional<Intersection> intersect(const Ray& ray, double tmax = kInfinity) override;
+    RayPacket::Mask intersect(const RayPacket& packet,
+                              RayPacket::Mask  active,
+                              double*          tmax,
+                              Intersection*    hits) override;
+    HitInfo GetHitInfo(const Ray& ray, const Intersection& isect) const override;
+    bool occluded(const Ray& ray, double tmax) override;
+    AABB GetBounds() const override;
+    void Commit() override;
+    void SetBVHLayout(BVHLayout layout) override;
+
+    int        GetTriangleCount()    const;
+    const BVH& GetBVH()              const;
+    // NB: Triangles address the vertex attributes by index, in BVH leaf
+    // order once committed.
+    const std::shared_ptr<const MeshBuffers>& GetBuffers() const;
+    const MeshIndices&                        GetIndices() const;
+    // NB: Bytes taken by the nodes of the selected tree.
+    size_t     GetBVHMemoryUsage()   const;
+
+    // NB: Replaces vertex attributes keeping the topology, e.g. for animated
+    // vertices. The BVH is refitted unless it has degraded too much, then
+    // it is rebuilt. Scene::Refit has to be called afterwards.
+    void SetBuffers(std::shared_ptr<const MeshBuffers> buffers);
+
+private:
+    std::vector<AABB> GetTriangleBounds() const;
+    // NB: Rebuilds per-triangle data from the current buffers.
+    void Update();
+
+    std::shared_ptr<const MeshBuffers> _buffers;
+    MeshIndices                        _indices;
+    BVH                                _bvh;
+    BVHLayout                          _layout = BVHLayout::kBinary;
+    WideBVH<4>                         _bvh4;
+    WideBVH<8>                         _bvh8;
+
+    // NB: Built on Commit, triangles are stored in the BVH leaf order
+    // and every leaf owns ceil(count / 4) consecutive packets. Leaves
+    // are looked up by their first triangle.
+    std::vector<TrianglePacket>        _packets;
+    std::vector<int>                   _leaf_packets;
+    std::vector<Vec3f>                 _normals;
+    // NB: Empty unless the material is bump mapped.
+    std::vector<TangentFrame>          _tangents;
+};
+
+// NB: Places a shared object into the scene with an affine transform, rays
+// are brought into object space during traversal. The prototype has to be
+// committed already (e.g. taken from a parsed Scene), so its acceleration
+// structure is built once for all of its instances. After its geometry
+// changes Scene::Refit has to be called with the indices of the instances.
+class Instance : public Object {
+public:
+    using Ptr = std::shared_ptr<Instance>;
+
+    Instance(Object::Ptr prototype, const Transform& transform);
 
-    Triangle(const std::array<GeometricVertex, 3>& v,
-             const Material&                     m  = {},
-             const OA<TextureVertex>             vt = {},
-             const OA<VertexNormal>              vn = {});
+    using Object::intersect;
+    std::optional<Intersection> intersect(const Ray& ray, double tmax = kInfinity) override;
+    HitInfo GetHitInfo(const Ray& ray, const Intersection& isect) const override;
+    bool occluded(const Ray& ray, double tmax) override;
+    AABB GetBounds() const override;
+
+    const Object::Ptr& GetPrototype() const;
+    const Transform&   GetTransform() const;
 
-    std::optional<HitInfo> intersect(const Ray& ray) override;
 private:
-    std::array<GeometricVertex, 3> geom_vertices;
-    OA<TextureVertex>              texture_vertices;
-    OA<VertexNormal>               vertex_normals;
+    // NB: Normalized object space ray, distances in object space are
+    // the world ones multiplied by scale.
+    Ray ToObject(const Ray& ray, double* scale) const;
 
-    Vec3f v0, v1, v2;
-    std::optional<ExplicitNormals> has_normals;
+    Object::Ptr _prototype;
+    Transform   _transform;
+    Transform   _inverse;
 };
 
 class Scene {
@@ -162,24 +311,112 @@ public:
           std::vector<GeometricVertex>&& geom_vertices);
 
     void AddLight(Light &&);
+    // NB: Selects the tree used by single ray queries of the scene
+    // and of every object and instance prototype, binary by default.
+    void SetBVHLayout(BVHLayout layout);
+    // NB: Refits the scene BVH after the geometry of the given objects
+    // (indices in GetObjects) has changed. Only the affected nodes are
+    // visited unless the tree has degraded too much and is rebuilt.
+    void Refit(const std::vector<int>& objects);
 
     const Objects&                      GetObjects()           const;
     const Lights&                       GetLights()            const;
     const std::vector<GeometricVertex>& GetGeometricVertices() const;
+    const BVH&                          GetBVH()               const;
+    BVHLayout                           GetBVHLayout()         const;
+    // NB: Time spent on building acceleration structures in milliseconds.
+    double                              GetBuildTime()         const;
+
+    // NB: Closest hit among all objects.
+    std::optional<Intersection> Intersect(const Ray& ray, double tmax = kInfinity) const;
+    // NB: Closest hits for every lane of the packet, returns the mask
+    // of lanes that hit anything.
+    RayPacket::Mask Intersect(const RayPacket& packet, Intersection* hits) const;
+    // NB: Stops at the first hit closer than tmax.
+    bool Occluded(const Ray& ray, double tmax) const;
 
 private:
     Objects                      _objects;
     Lights                       _lights;
     std::vector<GeometricVertex> _geom_vertices;
+    std::vector<AABB>            _bounds;
+    BVH                          _bvh;
+    BVHLayout                    _layout = BVHLayout::kBinary;
+    WideBVH<4>                   _bvh4;
+    WideBVH<8>                   _bvh8;
+    double                       _build_time = 0.0;
 };
 
 Vec3f Refract(const Vec3f& I, const Vec3f& N, double ior);
 Vec3f Reflect(const Vec3f& I, const Vec3f& N);
+// NB: Pending branch of a path, its radiance contributes
+// with the product of the weights of the hits leading to it.
+struct PathRay {
+    Ray   ray;
+    Vec3f weight;
+    int   depth;
+    bool  outside;
+};
+
+// NB: Light reaching a hit unless the shadow ray is occluded before distance.
+struct LightSample {
+    Ray    ray;
+    double distance;
+    Vec3f  diffuse;
+    Vec3f  specular;
+};
+
+struct SurfaceShading {
+    // NB: Radiance of the hit given the summed diffuse and specular
+    // light of its unoccluded samples.
+    Vec3f Radiance(const Vec3f& diffuse, const Vec3f& specular) const;
+
+    Vec3f emitted;
+    Vec3f Kd;
+    Vec3f Ks;
+};
+
+// NB: Shades the hit without tracing any ray. Appends a sample per light to
+// lights and the reflected and refracted branches surviving culling to
+// branches, both are left for the caller to trace.
+SurfaceShading ShadeSurface(const PathRay&            path,
+                            const Intersection&       isect,
+                            const Scene&              scene,
+                            const Options&            options,
+                            std::vector<LightSample>* lights,
+                            std::vector<PathRay>*     branches);
+
+// NB: Follows reflected and refracted branches iteratively with an explicit
+// per-thread stack, see RenderOptions::min_throughput for culling.
 Vec3f Trace(const Ray&     ray,
             const Scene&   scene,
             const Options& options,
             int            depth   = 0,
             bool           outside = true);
+// NB: Radiance leaving the closest hit of the ray, i.e. Trace
+// without the intersection step.
+Vec3f Shade(const Ray&          ray,
+            const Intersection& isect,
+            const Scene&        scene,
+            const Options&      options,
+            int                 depth   = 0,
+            bool                outside = true);
+
+bool IntersectTriangle(const TriangleRecord& tri,
+                       const Ray&            ray,
+                       double*               t,
+                       double*               u,
+                       double*               v);
+
+// NB: Tests the ray against every lane of the packet and returns the lane
+// of the nearest hit closer than *tmax or -1. On hit *tmax, *u and *v are
+// updated, ties go to the lowest lane. The AVX2 kernel is picked at runtime
+// when the CPU supports it, and selects the same lane with bit-identical
+// t, u and v as the scalar one.
+int IntersectPacket      (const TrianglePacket& packet, const Ray& ray,
+                          double* tmax, double* u, double* v);
+int IntersectPacketScalar(const TrianglePacket& packet, const Ray& ray,
+                          double* tmax, double* u, double* v);
 
 Vec3f CalculateBarycentric(const Vec3f& a,
                            const Vec3f& b,
@@ -2,6 +2,8 @@
 
 #include <string>
 #include <memory>
+#include <cstddef>
+#include <cstdint>
 
 struct RGB {
     int r, g, b;
@@ -10,11 +12,20 @@ struct RGB {
     }
 };
 
+// NB: 8-bit RGB or RGBA pixels in a single buffer, rows are Stride() bytes
+// apart. Copies share the pixels.
 class Image {
 public:
+    // NB: Owned rows start on 64-byte boundaries.
+    static constexpr size_t kAlignment = 64;
+
     Image();
     explicit Image(const std::string& filename);
-    Image(int width, int height);
+    // NB: Black and opaque.
+    Image(int width, int height, int channels = 4);
+    // NB: Wraps caller memory without copying, it must outlive the image
+    // and its copies. Zero stride means width * channels.
+    Image(uint8_t* data, int width, int height, int channels, size_t stride = 0);
 
     void Write   (const std::string& filename);
     void SetPixel(const RGB& pixel, int y, int x);
@@ -22,12 +33,39 @@ public:
     RGB GetPixel(int y, int x) const;
     int Height()               const;
     int Width()                const;
+    // NB: 3 for RGB or 4 for RGBA.
+    int Channels()             const;
+    size_t Stride()            const;
+
+    // NB: Width() * Channels() interleaved bytes of row y.
+          uint8_t* Row(int y);
+    const uint8_t* Row(int y) const;
 
 private:
-    void PrepareImage(int width, int height);
+    void PrepareImage(int width, int height, int channels);
     void ReadPng(const std::string& filename);
     void ReadJpg(const std::string& filename);
 
     struct Impl;
     std::shared_ptr<Impl> _impl;
 };
+
+// NB: Writes a PNG row by row from top to bottom, so the whole image never
+// has to be in memory.
+class PngWriter {
+public:
+    PngWriter(const std::string& filename, int width, int height, int channels = 3);
+    ~PngWriter();
+
+    PngWriter(const PngWriter&) = delete;
+    PngWriter& operator=(const PngWriter&) = delete;
+
+    // NB: Width * channels interleaved bytes.
+    void WriteRow(const uint8_t* row);
+    // NB: Must be called once every row is written.
+    void Finish();
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> _impl;
+};
@@ -25,6 +25,33 @@ struct CameraOptions {
 
 struct RenderOptions {
     int depth;
+    // NB: Side of the square pixel block traced as one packet of primary
+    // rays, e.g. 4 or 8. Zero traces every pixel separately.
+    int packet_size = 0;
+    // NB: Render threads, zero means one per hardware thread.
+    int num_threads = 0;
+    // NB: Side of the square tiles the image is scheduled in.
+    int tile_size   = 16;
+    // NB: Samples per pixel of the adaptive sampler. Every pixel gets
+    // min_samples, pixels whose contrast to a neighbour or estimated error
+    // of the mean exceeds sample_threshold get up to max_samples. One sample
+    // through the pixel center by default.
+    int    min_samples      = 1;
+    int    max_samples      = 1;
+    double sample_threshold = 0.05;
+    // NB: Reflected and refracted branches whose throughput (largest
+    // channel of the weight they contribute with) is below min_throughput
+    // are dropped, or with Russian roulette kept with a probability
+    // proportional to it. Branches of zero throughput are always dropped.
+    double min_throughput   = 0.0;
+    bool   russian_roulette = false;
+    // NB: Sorts the secondary and shadow rays of the wavefront pipeline by
+    // direction octant and origin before intersecting them.
+    bool   sort_rays        = false;
+    // NB: Spacing of the pixels traced by the first level of RenderPreview,
+    // halved by every next level, e.g. 8 for 8, 4, 2, 1. Zero or one
+    // renders the full image right away.
+    int    preview_step     = 0;
 };
 
 struct Options {
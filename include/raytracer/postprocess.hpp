@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "datatypes.hpp"
+
+// NB: Converts count pixels of radiance to interleaved 8-bit RGB: tone
+// mapping by the largest channel C of the frame, gamma 1/2.2 and truncation,
+// channels above C saturate.
+// The scalar kernel is the reference and calls std::pow per channel. The
+// other one quantizes through GammaTable and produces the same bytes, the
+// AVX2 kernel is picked at runtime when the CPU supports it.
+void ToneMap      (const Vec3f* pixels, size_t count, double C, uint8_t* rgb);
+void ToneMapScalar(const Vec3f* pixels, size_t count, double C, uint8_t* rgb);
+
+// NB: thresholds[b] is the smallest tone-mapped value the reference maps to
+// at least b, thresholds[0] is -infinity. Values are clamped to
+// [2^kMinExponent, 1], below which everything maps to 0, and looked up in
+// cells given by their exponent and top kMantissaBits mantissa bits. Cells
+// are narrow enough to hold at most one threshold: a cell stores the byte of
+// its start and the threshold inside it, or infinity.
+struct GammaTable {
+    static constexpr int kMantissaBits = 8;
+    static constexpr int kMinExponent  = -20;
+    static constexpr int kNumCells     = (-kMinExponent << kMantissaBits) + 1;
+
+    double  thresholds[256];
+    double  cell_thresholds[kNumCells];
+    int64_t cell_bytes[kNumCells];
+
+    // NB: Bits of 2^kMinExponent shifted to the cell index.
+    static uint64_t FirstCell();
+    static int      Cell(double t);
+};
+
+const GammaTable& GetGammaTable();
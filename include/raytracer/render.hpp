@@ -1,9 +1,209 @@
 #pragma once
 
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <stdexcept>
+
 #include <raytracer/options.hpp>
 #include <raytracer/image.hpp>
 #include <raytracer/datatypes.hpp>
 #include <raytracer/geometry.hpp>
+#include <raytracer/scheduler.hpp>
+#include <raytracer/wavefront.hpp>
+
+struct RenderStats {
+    // NB: Per render thread.
+    std::vector<ThreadStats> threads;
+    // NB: Primary rays traced.
+    int64_t                  samples = 0;
+    // NB: Filled by RenderWavefront only.
+    WavefrontStats           wavefront;
+};
 
 Image Render(const std::string& filename, const CameraOptions& camera_options, const RenderOptions& render_options);
-Image Render(const Scene& scene, const CameraOptions& camera_options, const RenderOptions& render_options);
+Image Render(const Scene& scene, const CameraOptions& camera_options, const RenderOptions& render_options,
+             RenderStats* stats = nullptr);
+// NB: Same as Render, but writes the pixels to an existing image of the screen
+// size, e.g. one wrapping a frame buffer of the caller. Alpha is kept.
+void RenderInto(const Scene& scene, const CameraOptions& camera_options, const RenderOptions& render_options,
+                Image* image, RenderStats* stats = nullptr);
+// NB: Caller-owned float RGB or RGBA pixels, rows are stride floats apart,
+// zero stride means width * channels.
+struct HdrBuffer {
+    float* data     = nullptr;
+    int    width    = 0;
+    int    height   = 0;
+    int    channels = 3;
+    size_t stride   = 0;
+};
+
+// NB: Fills output with the radiance of every pixel as returned by Trace,
+// before tone mapping, alpha is set to one. No Image is created. Radiance is
+// staged as doubles a band of rows at a time, or the whole frame at once
+// with adaptive sampling.
+void RenderHdr(const Scene& scene, const CameraOptions& camera_options, const RenderOptions& render_options,
+               const HdrBuffer& output, RenderStats* stats = nullptr);
+// NB: Same, returns width * height interleaved RGB floats.
+std::vector<float> RenderHdr(const Scene& scene, const CameraOptions& camera_options,
+                             const RenderOptions& render_options, RenderStats* stats = nullptr);
+
+// NB: The tone mapping stage of Render on its own. Radiance rounded to floats
+// may move pixels by one level compared to Render.
+Image ToneMapHdr(const HdrBuffer& input, int num_threads = 0);
+void  ToneMapHdr(const HdrBuffer& input, Image* image, int num_threads = 0);
+
+struct StreamOptions {
+    // NB: Rows rendered at once, memory use is proportional to it.
+    int    band_height   = 64;
+    // NB: Channel value the image is tone mapped with, brighter ones
+    // saturate. Zero means it is estimated first from the largest channel of
+    // every estimate_step-th pixel in both directions.
+    double tone_max      = 0.0;
+    int    estimate_step = 8;
+};
+
+// NB: Called with consecutive bands of tone-mapped rows, the first of them
+// is row y0 of the image.
+using BandCallback = std::function<void(const Image& band, int y0)>;
+
+// NB: Renders the screen band by band, so memory use doesn't grow with its
+// height. With StreamOptions::tone_max set to the largest channel of the
+// frame and no adaptive sampling the rows match Render.
+void RenderStreamed(const Scene& scene, const CameraOptions& camera_options,
+                    const RenderOptions& render_options, const StreamOptions& stream_options,
+                    const BandCallback& on_band);
+// NB: RenderStreamed straight to a PNG file.
+void RenderToPng(const Scene& scene, const CameraOptions& camera_options,
+                 const RenderOptions& render_options, const StreamOptions& stream_options,
+                 const std::string& filename);
+
+// NB: Called from the render threads once the radiance of the tile, indexed
+// radiance(x, y), is final. Other tiles might still be written concurrently.
+using TileCallback = std::function<void(const Tile&, const Matf& radiance)>;
+
+class RenderCancelled : public std::runtime_error {
+public:
+    RenderCancelled() : std::runtime_error("Render cancelled") {
+    }
+};
+
+// NB: Render in progress on a background thread, see RenderAsync.
+// Destroying the handle cancels the render and waits for it to stop.
+class RenderHandle {
+public:
+    struct State;
+    explicit RenderHandle(std::shared_ptr<State> state);
+    RenderHandle(RenderHandle&&) = default;
+    RenderHandle& operator=(RenderHandle&&) = delete;
+    ~RenderHandle();
+
+    // NB: Share of the work done, in [0, 1].
+    double GetProgress() const;
+    // NB: Asks the render to stop, checked between tiles.
+    void   Cancel();
+    bool   IsDone()      const;
+    // NB: Returns whether the render has finished within ms.
+    bool   WaitFor(double ms) const;
+    // NB: Waits for the image. Rethrows the error the render has failed
+    // with, throws RenderCancelled if it was cancelled before the last tile.
+    Image  Get();
+    // NB: Statistics of the finished render, waits for it like Get.
+    const RenderStats& GetStats() const;
+
+private:
+    std::shared_ptr<State> _state;
+};
+
+// NB: Starts Render on a background thread and returns immediately. The
+// scene must outlive the render. on_tile is called as tiles complete.
+RenderHandle RenderAsync(const Scene& scene, const CameraOptions& camera_options,
+                         const RenderOptions& render_options, TileCallback on_tile = {});
+
+// NB: Renders the same image as Render with one sample per pixel center
+// through the stage by stage pipeline of WavefrontTracer. Packets and
+// adaptive sampling don't apply.
+Image RenderWavefront(const Scene& scene, const CameraOptions& camera_options,
+                      const RenderOptions& render_options, RenderStats* stats = nullptr);
+
+struct CheckpointOptions {
+    std::string path;
+    // NB: Time between checkpoints, must be positive.
+    double      interval_ms = 60000;
+    // NB: Called from the writer thread when a checkpoint can't be written,
+    // it is retried at the next interval. Messages go to stderr if empty.
+    std::function<void(const std::string& message)> on_error;
+};
+
+// NB: Render which periodically saves the radiance of the finished tiles
+// to checkpoint_options.path from a background thread, render threads never
+// wait for it. If the file exists, the render resumes from it and skips the
+// tiles it has, it must have been written with the same options. Only the
+// first checkpoint must succeed, later failures are reported and don't stop
+// the render. The file is removed once the render is done. Adaptive sampling
+// doesn't apply.
+Image RenderCheckpointed(const Scene& scene, const CameraOptions& camera_options,
+                         const RenderOptions& render_options,
+                         const CheckpointOptions& checkpoint_options, RenderStats* stats = nullptr);
+
+struct RenderQuality {
+    // NB: Depth every pixel was traced with, 1 for the preview
+    // and 0 if not even that was finished.
+    int    depth       = 0;
+    // NB: Fewest and most samples per pixel at the requested depth.
+    int    min_samples = 0;
+    int    max_samples = 0;
+    // NB: Share of pixels with at least one sample at the requested depth.
+    double coverage    = 0.0;
+    double elapsed_ms  = 0.0;
+    // NB: The requested depth and max_samples were reached everywhere.
+    bool   complete    = false;
+};
+
+// NB: Renders coarse-to-fine within a wall-clock budget: a preview with
+// direct light only, then the requested depth through pixel centers, then
+// jittered samples up to max_samples per pixel (adaptive sampling doesn't
+// apply). Returns the best image available once all passes are done or the
+// budget has run out. The deadline is checked before every tile, so the
+// budget is overrun by at most a tile per thread. An infinite budget never
+// runs out. With a budget large enough and max_samples 1 the image equals
+// the one of Render.
+Image RenderBudgeted(const Scene& scene, const CameraOptions& camera_options,
+                     const RenderOptions& render_options, double budget_ms,
+                     RenderQuality* quality = nullptr);
+
+// NB: Called with the image of every preview level, where step is the
+// spacing of the traced pixels, 1 for the final image.
+using PreviewCallback = std::function<void(const Image& image, int step)>;
+
+// NB: Renders the pixels on a grid of RenderOptions::preview_step first and
+// fills the others with the nearest traced pixel above and to the left, then
+// halves the step until every pixel is traced. Pixels traced by a level
+// are reused by the next ones. The final image equals the one of Render
+// without packets and adaptive sampling and is returned.
+Image RenderPreview(const Scene& scene, const CameraOptions& camera_options,
+                    const RenderOptions& render_options, const PreviewCallback& on_level);
+
+// NB: Renders the image in passes of one sample per pixel accumulated into
+// an HDR buffer, every pass refines the previous ones. The first pass samples
+// pixel centers, the next ones jittered positions. The scene must outlive
+// the renderer.
+class ProgressiveRenderer {
+public:
+    ProgressiveRenderer(const Scene&         scene,
+                        const CameraOptions& camera_options,
+                        const RenderOptions& render_options);
+
+    // NB: Adds a pass and returns the tone mapped mean of all passes.
+    Image RenderPass();
+    Image GetSnapshot()  const;
+    int   GetPassCount() const;
+    // NB: Thread statistics of the last pass.
+    const std::vector<ThreadStats>& GetStats() const;
+
+private:
+    struct Impl;
+    std::shared_ptr<Impl> _impl;
+};
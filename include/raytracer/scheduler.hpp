@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+// NB: Pixel rectangle [x0, x1) x [y0, y1).
+struct Tile {
+    int x0, y0;
+    int x1, y1;
+};
+
+struct ThreadStats {
+    // NB: Time spent on tiles and waiting for the other threads, in ms.
+    double busy_ms = 0.0;
+    double idle_ms = 0.0;
+    int    tiles   = 0;
+    // NB: Tiles taken from other threads' queues.
+    int    stolen  = 0;
+};
+
+// NB: Splits the image into square tiles in Morton order and renders them on
+// a pool of threads. Every thread owns a deque seeded with a contiguous run of
+// tiles, takes work from its front and steals from the back of the others
+// once it runs out, so expensive regions don't leave threads idle.
+class TileScheduler {
+public:
+    // NB: Zero threads means one per hardware thread.
+    TileScheduler(int width, int height, int tile_size, int num_threads = 0);
+
+    // NB: Calls f(tile, thread) for every tile and returns once all are done.
+    // An exception thrown by f stops the remaining work and is rethrown, so
+    // is the error of a thread that can't be started. Returns false if
+    // Cancel was called during the run.
+    bool Run(const std::function<void(const Tile&, int)>& f);
+
+    // NB: Stops the current Run from any thread, tiles being rendered are
+    // finished but no new ones are started.
+    void Cancel();
+
+    const std::vector<Tile>&        GetTiles()       const;
+    int                             GetNumThreads()  const;
+    // NB: Statistics of the last Run, one entry per thread.
+    const std::vector<ThreadStats>& GetStats()       const;
+
+private:
+    std::vector<Tile>        _tiles;
+    int                      _num_threads;
+    std::vector<ThreadStats> _stats;
+    std::atomic<bool>        _cancelled{false};
+};
+
+// NB: Calls f(i) for every i in [0, count) on num_threads threads (zero means
+// one per hardware thread), indices are handed out in increasing order.
+// The first exception thrown by f, or the error of a thread that can't be
+// started, is rethrown once all threads are done.
+void ParallelFor(int count, int num_threads, const std::function<void(int)>& f);
+
+// NB: Interleaves the bits of x and y.
+uint32_t MortonCode(uint32_t x, uint32_t y);
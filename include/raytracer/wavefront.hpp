@@ -0,0 +1,94 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <optional>
+
+#include "geometry.hpp"
+
+// NB: Ray of a path contributing to pixel.
+struct WavefrontRay {
+    PathRay path;
+    int64_t pixel;
+};
+
+struct WavefrontStats {
+    // NB: Time spent in every stage, in ms. Camera rays
+    // are generated by the caller, e.g. RenderWavefront.
+    double  camera_ms    = 0.0;
+    double  intersect_ms = 0.0;
+    double  shade_ms     = 0.0;
+    double  shadow_ms    = 0.0;
+    double  emit_ms      = 0.0;
+    double  sort_ms      = 0.0;
+    // NB: Path and shadow rays traced and BVH nodes they visited.
+    int64_t rays         = 0;
+    int64_t shadow_rays  = 0;
+    int64_t nodes        = 0;
+    int64_t shadow_nodes = 0;
+    // NB: Passes of the pipeline, one per bounce of every batch.
+    int     waves        = 0;
+};
+
+// NB: Direction octant in the highest bits followed by the Morton code of the
+// origin quantized to 10 bits per axis within bounds.
+uint64_t SortKey(const Ray& ray, const AABB& bounds);
+
+// NB: Traces rays stage by stage instead of path by path. Every wave finds
+// the closest hits of the whole queue, shades them into light samples and
+// secondary rays, tests the light samples for occlusion, adds the radiance
+// to the pixels and continues with the secondary rays. Every stage runs as
+// a batch over all threads, results match Trace up to the order radiance
+// is summed in. With RenderOptions::sort_rays the secondary and shadow rays
+// are ordered by SortKey first, so rays traversing the same nodes are
+// intersected back to back.
+class WavefrontTracer {
+public:
+    WavefrontTracer(const Scene& scene, const Options& options);
+
+    // NB: Adds the radiance of the rays to radiance[pixel]. The queue is
+    // used for the secondary rays too and is left empty.
+    void Trace(std::vector<WavefrontRay>* rays, std::vector<Vec3f>* radiance);
+
+    const WavefrontStats& GetStats() const;
+
+private:
+    // NB: Shaded hit waiting for the occlusion of its light samples.
+    struct Shaded {
+        int64_t        pixel;
+        Vec3f          weight;
+        SurfaceShading shading;
+        size_t         first_light;
+        size_t         num_lights;
+    };
+
+    // NB: Output of the shading stage for a chunk of the queue, kept per
+    // chunk so the result doesn't depend on the threads.
+    struct Chunk {
+        std::vector<Shaded>       shaded;
+        std::vector<LightSample>  lights;
+        std::vector<char>         visible;
+        std::vector<WavefrontRay> rays;
+    };
+
+    // NB: Light sample k of chunk, in the order they are tested.
+    struct ShadowRef {
+        uint64_t key;
+        int      chunk;
+        int      index;
+    };
+
+    void SortRays(std::vector<WavefrontRay>* rays);
+
+    const Scene&   _scene;
+    Options        _options;
+    WavefrontStats _stats;
+
+    // NB: Stage buffers, kept to reuse their memory across waves and calls.
+    std::vector<std::optional<Intersection>> _hits;
+    std::vector<Chunk>                       _chunks;
+    std::vector<ShadowRef>                   _shadow_refs;
+    std::vector<std::pair<uint64_t, int>>    _keys;
+    std::vector<WavefrontRay>                _sorted;
+    AABB                                     _bounds;
+};
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "bvh.hpp"
+
+// NB: Tree used by single ray queries of Scene and TriangleMesh.
+enum class BVHLayout {
+    kBinary,
+    kWide4,
+    kWide8
+};
+
+// NB: Node of a wide BVH with up to N children in structure-of-arrays lanes.
+// Child boxes are quantized conservatively to 8 bits relative to the node
+// bounds: lo = origin + qlo * scale, hi = origin + qhi * scale.
+template <int N>
+struct alignas(32) WideNode {
+    static constexpr int kWidth = N;
+
+    double  origin[3];
+    double  scale[3];
+    uint8_t qlo[3][N];
+    uint8_t qhi[3][N];
+    // NB: Index of the child node, first primitive for leaf children.
+    int     child[N];
+    // NB: Number of primitives of a leaf child, 0 for inner children.
+    int     count[N];
+    int     num_children;
+};
+
+// NB: Tests the ray against every child box of the node and returns the mask
+// of children entered before tmax, entry distances are written to tnear.
+// The AVX2 kernel is picked at runtime when the CPU supports it and returns
+// bit-identical results to the scalar one.
+template <int N>
+uint32_t IntersectChildren      (const WideNode<N>& node, const Vec3f& orig,
+                                 const Vec3f& inv_dir, double tmax, double* tnear);
+template <int N>
+uint32_t IntersectChildrenScalar(const WideNode<N>& node, const Vec3f& orig,
+                                 const Vec3f& inv_dir, double tmax, double* tnear);
+
+// NB: N-ary tree collapsed from a binary BVH, so it references primitives
+// through the indices of that BVH. Used for single ray traversal only.
+template <int N>
+class WideBVH {
+public:
+    using Node = WideNode<N>;
+
+    WideBVH() = default;
+    explicit WideBVH(const BVH& bvh);
+
+    const std::vector<Node>& GetNodes()       const;
+    // NB: Bytes taken by the nodes.
+    size_t                   GetMemoryUsage() const;
+
+    // NB: Requantizes the nodes affected by BVH::Refit, changed is the
+    // list of BVH nodes it has returned. Does nothing for an empty tree.
+    void Refit(const BVH& bvh, const std::vector<int>& changed);
+
+    // NB: Visits the leaves front-to-back and calls f(first, count, tmax)
+    // for every leaf entered before tmax, where [first, first + count) is
+    // the range of BVH indices of the leaf. f may shrink tmax to prune the
+    // rest of traversal and returns true to stop it.
+    template <typename F>
+    void TraverseLeaves(const Vec3f& orig, const Vec3f& dir, double tmax, F&& f) const;
+
+private:
+    int  Build   (const BVH& bvh, int root);
+    void Quantize(const BVH& bvh, int idx);
+
+    // NB: BVH nodes a wide node was collapsed from.
+    struct Source {
+        int root;
+        int children[N];
+    };
+
+    std::vector<Node>   _nodes;
+    std::vector<Source> _sources;
+    // NB: Per BVH node, the wide node which has it as a child
+    // and the one rooted at it, -1 if none.
+    std::vector<int>    _child_of;
+    std::vector<int>    _root_of;
+};
+
+template <int N>
+template <typename F>
+void WideBVH<N>::TraverseLeaves(const Vec3f& orig, const Vec3f& dir, double tmax,
+                                F&& f) const {
+    if (_nodes.empty()) {
+        return;
+    }
+
+    const Vec3f inv_dir{1 / dir.x, 1 / dir.y, 1 / dir.z};
+
+    struct Entry {
+        int    child;
+        int    count;
+        double tnear;
+    };
+
+    // NB: Every visited node replaces one entry with at most N.
+    Entry stack[BVH::kMaxDepth * (N - 1) + 1];
+    int top = 0;
+    stack[top++] = Entry{0, 0, 0.0};
+    int64_t visited = 0;
+
+    while (top > 0) {
+        const auto entry = stack[--top];
+        // NB: Closest hit might have been found since the entry was pushed.
+        if (entry.tnear > tmax) {
+            continue;
+        }
+        ++visited;
+
+        if (entry.count > 0) {
+            if (f(entry.child, entry.count, tmax)) {
+                break;
+            }
+            continue;
+        }
+
+        const auto& node = _nodes[entry.child];
+        double   tnear[N];
+        uint32_t mask = IntersectChildren(node, orig, inv_dir, tmax, tnear);
+
+        // NB: Push children far to near, so the nearest one is visited next.
+        const int first = top;
+        for (int i = 0; i < node.num_children; ++i) {
+            if (!(mask >> i & 1)) {
+                continue;
+            }
+            int pos = top++;
+            while (pos > first && stack[pos - 1].tnear < tnear[i]) {
+                stack[pos] = stack[pos - 1];
+                --pos;
+            }
+            stack[pos] = Entry{node.child[i], node.count[i], tnear[i]};
+        }
+    }
+    GetTraversalCounters().nodes += visited;
+}
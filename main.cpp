@@ -54,12 +54,36 @@ int main(int argc, const char** argv) {
     }
 
     double zoom = 1.0;
-    if (argc == 3) {
+    if (argc >= 3) {
         zoom = std::stod(argv[2]);
     }
 
+    // NB: Optional side of the pixel block traced as a ray packet.
+    if (argc >= 4) {
+        render_opts.packet_size = std::stoi(argv[3]);
+    }
+
+    // NB: Optional tree layout: binary, wide4 or wide8.
+    BVHLayout layout = BVHLayout::kBinary;
+    if (argc >= 5) {
+        const std::string name = argv[4];
+        if (name == "wide4") {
+            layout = BVHLayout::kWide4;
+        } else if (name == "wide8") {
+            layout = BVHLayout::kWide8;
+        } else if (name != "binary") {
+            throw std::logic_error("Unknown BVH layout: " + name);
+        }
+    }
+
+    // NB: Optional coarsest pixel spacing of the interleaved preview, e.g. 8.
+    if (argc >= 6) {
+        render_opts.preview_step = std::stoi(argv[5]);
+    }
+
     const std::string obj_filename = argv[1];
     auto scene  = Parse(obj_filename);
+    scene.SetBVHLayout(layout);
     BBox bbox(scene.GetGeometricVertices());
     auto c = bbox.GetCenter();
     auto d = bbox.GetDiag();
@@ -78,17 +102,41 @@ int main(int argc, const char** argv) {
     }
 
     std::cout << "[INFO] Number of objects on scene: " << scene.GetObjects().size() << std::endl;
+    std::cout << "[INFO] BVH nodes: " << scene.GetBVH().GetNodes().size()
+              << ", build time: " << scene.GetBuildTime() << " ms" << std::endl;
 
     camera_opts.look_from = std::array<double, 3>{look.x, look.y, look.z};
     camera_opts.look_to   = std::array<double, 3>{c.x, c.y, c.z};
 
     using namespace std::chrono;
     auto start   = high_resolution_clock::now();
-    auto image   = Render(scene, camera_opts, render_opts);
+    RenderStats stats;
+    Image image;
+    if (render_opts.preview_step > 1) {
+        image = RenderPreview(scene, camera_opts, render_opts, [&](const Image& level, int step) {
+            if (step == 1) {
+                return;
+            }
+            auto now      = high_resolution_clock::now();
+            auto filename = "preview-" + std::to_string(step) + ".png";
+            Image(level).Write(filename);
+            std::cout << "[INFO] Preview with step " << step << " after "
+                      << duration_cast<milliseconds>(now - start).count()
+                      << " ms, dump to " << filename << std::endl;
+        });
+    } else {
+        image = Render(scene, camera_opts, render_opts, &stats);
+    }
     auto end     = high_resolution_clock::now();
     auto elapsed = duration_cast<milliseconds>(end-start).count();
 
     std::cout << "[INFO] Rendering time: " << elapsed  << " ms" << std::endl;
+    for (int t = 0; t < stats.threads.size(); ++t) {
+        const auto& s = stats.threads[t];
+        std::cout << "[INFO] Thread " << t << ": busy " << s.busy_ms << " ms, idle "
+                  << s.idle_ms << " ms, tiles " << s.tiles << " (" << s.stolen
+                  << " stolen)" << std::endl;
+    }
 
     image.Write("output.png");
     std::cout << "[INFO] Dump result to output.png" << std::endl;
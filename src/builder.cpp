@@ -37,40 +37,107 @@ SceneBuilder& SceneBuilder::Add(const SphereElement& s) {
     return *this;
 }
 
+SceneBuilder& SceneBuilder::Add(const Instance::Ptr& instance) {
+    _state->objects.push_back(instance);
+    return *this;
+}
+
 SceneBuilder& SceneBuilder::Add(const FaceElement& f) {
-    std::vector<int> indices;
-    for (int i = 0; i < f.vertices.size(); ++i) {
-        indices.push_back(GetNormalizedIndex(f.vertices[i].v, _state->geom_vertices.size()));
+    auto& meshes = _state->meshes;
+    auto [it, added] = _state->mesh_index.emplace(_state->material.name, meshes.size());
+    if (added) {
+        meshes.push_back(Mesh{_state->material, {}});
+    }
+    auto& indices = meshes[it->second].indices;
+
+    const int num_v  = _state->geom_vertices.size();
+    const int num_vt = _state->texture_vertices.size();
+    const int num_vn = _state->vertex_normals.size();
+
+    const bool has_vt = f.vertices[0].vt.has_value();
+    const bool has_vn = f.vertices[0].vn.has_value();
+    // NB: Optional buffers are allocated lazily by the first face that needs them.
+    if (has_vt && indices.vt.empty()) {
+        indices.vt.assign(indices.v.size(), -1);
+    }
+    if (has_vn && indices.vn.empty()) {
+        indices.vn.assign(indices.v.size(), -1);
     }
 
     for (int i = 0; i < f.vertices.size()-2; ++i) {
-        std::array<GeometricVertex, 3> v = {_state->geom_vertices[indices[0  ]],
-                                            _state->geom_vertices[indices[i+1]],
-                                            _state->geom_vertices[indices[i+2]]};
-        std::optional<std::array<TextureVertex, 3>> vt;
-        if (f.vertices[0].vt) {
-            auto i0 = GetNormalizedIndex(f.vertices[0  ].vt.value(), _state->texture_vertices.size());
-            auto i1 = GetNormalizedIndex(f.vertices[i+1].vt.value(), _state->texture_vertices.size());
-            auto i2 = GetNormalizedIndex(f.vertices[i+2].vt.value(), _state->texture_vertices.size());
-            vt = std::make_optional(std::array<TextureVertex, 3>{_state->texture_vertices[i0],
-                                                                 _state->texture_vertices[i1],
-                                                                 _state->texture_vertices[i2]});
+        const auto& f0 = f.vertices[0];
+        const auto& f1 = f.vertices[i+1];
+        const auto& f2 = f.vertices[i+2];
+
+        indices.v.push_back(GetNormalizedIndex(f0.v, num_v));
+        indices.v.push_back(GetNormalizedIndex(f1.v, num_v));
+        indices.v.push_back(GetNormalizedIndex(f2.v, num_v));
+
+        if (has_vt) {
+            indices.vt.push_back(GetNormalizedIndex(f0.vt.value(), num_vt));
+            indices.vt.push_back(GetNormalizedIndex(f1.vt.value(), num_vt));
+            indices.vt.push_back(GetNormalizedIndex(f2.vt.value(), num_vt));
+        } else if (!indices.vt.empty()) {
+            indices.vt.insert(indices.vt.end(), 3, -1);
         }
-        std::optional<std::array<VertexNormal, 3>> vn;
-        if (f.vertices[0].vn) {
-            auto i0 = GetNormalizedIndex(f.vertices[0  ].vn.value(), _state->vertex_normals.size());
-            auto i1 = GetNormalizedIndex(f.vertices[i+1].vn.value(), _state->vertex_normals.size());
-            auto i2 = GetNormalizedIndex(f.vertices[i+2].vn.value(), _state->vertex_normals.size());
-            vn = std::make_optional(std::array<VertexNormal, 3>{_state->vertex_normals[i0],
-                                                                _state->vertex_normals[i1],
-                                                                _state->vertex_normals[i2]});
+
+        if (has_vn) {
+            indices.vn.push_back(GetNormalizedIndex(f0.vn.value(), num_vn));
+            indices.vn.push_back(GetNormalizedIndex(f1.vn.value(), num_vn));
+            indices.vn.push_back(GetNormalizedIndex(f2.vn.value(), num_vn));
+        } else if (!indices.vn.empty()) {
+            indices.vn.insert(indices.vn.end(), 3, -1);
         }
-        _state->objects.push_back(std::make_shared<Triangle>(v, _state->material, vt, vn));
     }
     return *this;
 }
 
+static std::shared_ptr<const MeshBuffers>
+MakeMeshBuffers(const std::vector<GeometricVertex>& geom_vertices,
+                const std::vector<TextureVertex>&   texture_vertices,
+                const std::vector<VertexNormal>&    vertex_normals) {
+    auto buffers = std::make_shared<MeshBuffers>();
+
+    buffers->px.reserve(geom_vertices.size());
+    buffers->py.reserve(geom_vertices.size());
+    buffers->pz.reserve(geom_vertices.size());
+    for (const auto& v : geom_vertices) {
+        buffers->px.push_back(v.x);
+        buffers->py.push_back(v.y);
+        buffers->pz.push_back(v.z);
+    }
+
+    buffers->tu.reserve(texture_vertices.size());
+    buffers->tv.reserve(texture_vertices.size());
+    for (const auto& vt : texture_vertices) {
+        buffers->tu.push_back(vt.u);
+        buffers->tv.push_back(vt.v);
+    }
+
+    buffers->nx.reserve(vertex_normals.size());
+    buffers->ny.reserve(vertex_normals.size());
+    buffers->nz.reserve(vertex_normals.size());
+    for (const auto& vn : vertex_normals) {
+        auto n = Vec3f{vn.i, vn.j, vn.k}.normalize();
+        buffers->nx.push_back(n.x);
+        buffers->ny.push_back(n.y);
+        buffers->nz.push_back(n.z);
+    }
+
+    return buffers;
+}
+
 Scene SceneBuilder::Finalize() {
+    if (!_state->meshes.empty()) {
+        auto buffers = MakeMeshBuffers(_state->geom_vertices,
+                                       _state->texture_vertices,
+                                       _state->vertex_normals);
+        for (auto&& mesh : _state->meshes) {
+            _state->objects.push_back(
+                    std::make_shared<TriangleMesh>(buffers, std::move(mesh.indices), mesh.material));
+        }
+    }
+
     Scene scene{std::move(_state->objects),
                 std::move(_state->lights),
                 std::move(_state->geom_vertices)};
@@ -0,0 +1,428 @@
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <queue>
+
+#include <raytracer/bvh.hpp>
+
+/* ############################################# AABB Implementation ########################################## */
+
+AABB::AABB(const Vec3f& lo, const Vec3f& hi)
+    : lo(lo), hi(hi) {
+}
+
+void AABB::Extend(const Vec3f& p) {
+    lo = Vec3f{std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z)};
+    hi = Vec3f{std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z)};
+}
+
+void AABB::Extend(const AABB& box) {
+    Extend(box.lo);
+    Extend(box.hi);
+}
+
+bool AABB::IsEmpty() const {
+    return lo.x > hi.x || lo.y > hi.y || lo.z > hi.z;
+}
+
+Vec3f AABB::Centroid() const {
+    return (lo + hi) * 0.5;
+}
+
+Vec3f AABB::Extent() const {
+    return hi - lo;
+}
+
+double AABB::SurfaceArea() const {
+    if (IsEmpty()) {
+        return 0.0;
+    }
+    auto e = Extent();
+    return 2 * (e.x * e.y + e.y * e.z + e.z * e.x);
+}
+
+bool AABB::Intersect(const Vec3f& orig,
+                     const Vec3f& inv_dir,
+                     double       tmax,
+                     double*      tnear) const {
+    double t0 = 0;
+    double t1 = tmax;
+
+    // NB: Comparisons with nan (0 * inf) are false,
+    // so degenerate slabs never cull the box.
+    auto slab = [&](double lo, double hi, double o, double inv) {
+        double tlo = (lo - o) * inv;
+        double thi = (hi - o) * inv;
+        if (tlo > thi) {
+            std::swap(tlo, thi);
+        }
+        if (tlo > t0) {
+            t0 = tlo;
+        }
+        if (thi < t1) {
+            t1 = thi;
+        }
+    };
+
+    slab(lo.x, hi.x, orig.x, inv_dir.x);
+    slab(lo.y, hi.y, orig.y, inv_dir.y);
+    slab(lo.z, hi.z, orig.z, inv_dir.z);
+
+    *tnear = t0;
+    return t0 <= t1;
+}
+
+/* ############################################# BVH Implementation ########################################### */
+
+static constexpr int    kNumBins       = 16;
+static constexpr int    kMaxLeafSize   = 4;
+static constexpr double kTraversalCost = 1.0;
+static constexpr double kIntersectCost = 1.0;
+
+static double Axis(const Vec3f& v, int axis) {
+    return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+static double WeightedArea(const BVH::Node& node) {
+    const double cost = node.count > 0 ? kIntersectCost * node.count : kTraversalCost;
+    return cost * node.bounds.SurfaceArea();
+}
+
+static bool IsSame(const AABB& a, const AABB& b) {
+    return a.lo.x == b.lo.x && a.lo.y == b.lo.y && a.lo.z == b.lo.z &&
+           a.hi.x == b.hi.x && a.hi.y == b.hi.y && a.hi.z == b.hi.z;
+}
+
+BVH::BVH(const std::vector<AABB>& bounds) {
+    if (bounds.empty()) {
+        return;
+    }
+
+    std::vector<Vec3f> centroids;
+    centroids.reserve(bounds.size());
+    for (const auto& b : bounds) {
+        centroids.push_back(b.Centroid());
+    }
+
+    _indices.resize(bounds.size());
+    std::iota(_indices.begin(), _indices.end(), 0);
+
+    _nodes.reserve(2 * bounds.size());
+    Build(bounds, centroids, 0, static_cast<int>(bounds.size()), 0);
+    _nodes.shrink_to_fit();
+    Link();
+
+    for (const auto& node : _nodes) {
+        _weighted_area += WeightedArea(node);
+    }
+    _build_cost = GetCost();
+}
+
+void BVH::Link() {
+    _parents.assign(_nodes.size(), -1);
+    _leaves.assign(_indices.size(), -1);
+    for (int n = 0; n < static_cast<int>(_nodes.size()); ++n) {
+        const auto& node = _nodes[n];
+        if (node.count > 0) {
+            for (int i = node.offset; i < node.offset + node.count; ++i) {
+                _leaves[_indices[i]] = n;
+            }
+        } else {
+            _parents[n + 1]       = n;
+            _parents[node.offset] = n;
+        }
+    }
+}
+
+int BVH::Build(const std::vector<AABB>&  bounds,
+               const std::vector<Vec3f>& centroids,
+               int                       begin,
+               int                       end,
+               int                       depth) {
+    const int idx = static_cast<int>(_nodes.size());
+    _nodes.push_back(Node{});
+
+    AABB box, centroid_box;
+    for (int i = begin; i < end; ++i) {
+        box.Extend(bounds[_indices[i]]);
+        centroid_box.Extend(centroids[_indices[i]]);
+    }
+    _nodes[idx].bounds = box;
+
+    const int count = end - begin;
+    auto make_leaf = [&]() {
+        _nodes[idx].offset = begin;
+        _nodes[idx].count  = count;
+        return idx;
+    };
+
+    if (count == 1 || depth == kMaxDepth) {
+        return make_leaf();
+    }
+
+    // NB: Binned SAH over every axis with non-degenerate centroid extent.
+    struct Bin {
+        AABB box;
+        int  count = 0;
+    };
+
+    const auto extent = centroid_box.Extent();
+    double best_cost  = std::numeric_limits<double>::max();
+    int    best_axis  = -1;
+    int    best_split = -1;
+
+    for (int axis = 0; axis < 3; ++axis) {
+        const double lo  = Axis(centroid_box.lo, axis);
+        const double len = Axis(extent, axis);
+        if (len <= 0) {
+            continue;
+        }
+
+        Bin bins[kNumBins];
+        for (int i = begin; i < end; ++i) {
+            const auto p = _indices[i];
+            int b = static_cast<int>(kNumBins * (Axis(centroids[p], axis) - lo) / len);
+            b = std::min(b, kNumBins - 1);
+            bins[b].box.Extend(bounds[p]);
+            ++bins[b].count;
+        }
+
+        // NB: Sweep from the right to get areas of every right-hand side.
+        double right_area[kNumBins];
+        int    right_count[kNumBins];
+        AABB   acc;
+        int    acc_count = 0;
+        for (int b = kNumBins - 1; b > 0; --b) {
+            acc.Extend(bins[b].box);
+            acc_count += bins[b].count;
+            right_area[b]  = acc.SurfaceArea();
+            right_count[b] = acc_count;
+        }
+
+        acc = AABB{};
+        acc_count = 0;
+        for (int b = 0; b < kNumBins - 1; ++b) {
+            acc.Extend(bins[b].box);
+            acc_count += bins[b].count;
+            if (acc_count == 0 || right_count[b + 1] == 0) {
+                continue;
+            }
+            double cost = acc.SurfaceArea() * acc_count +
+                          right_area[b + 1] * right_count[b + 1];
+            if (cost < best_cost) {
+                best_cost  = cost;
+                best_axis  = axis;
+                best_split = b;
+            }
+        }
+    }
+
+    const double area      = box.SurfaceArea();
+    const double leaf_cost = kIntersectCost * count;
+    const double split_cost =
+        best_axis < 0 ? std::numeric_limits<double>::max()
+                      : kTraversalCost + kIntersectCost * best_cost / area;
+
+    if (split_cost >= leaf_cost && count <= kMaxLeafSize) {
+        return make_leaf();
+    }
+
+    int mid = begin;
+    if (best_axis >= 0) {
+        const double lo  = Axis(centroid_box.lo, best_axis);
+        const double len = Axis(extent, best_axis);
+        auto it = std::partition(_indices.begin() + begin, _indices.begin() + end,
+                [&](int p) {
+                    int b = static_cast<int>(kNumBins * (Axis(centroids[p], best_axis) - lo) / len);
+                    return std::min(b, kNumBins - 1) <= best_split;
+                });
+        mid = static_cast<int>(it - _indices.begin());
+    } else {
+        // NB: All centroids coincide, SAH can't separate them.
+        mid = begin + count / 2;
+    }
+
+    // NB: The left child is always emitted right after its parent.
+    Build(bounds, centroids, begin, mid, depth + 1);
+    const int right = Build(bounds, centroids, mid, end, depth + 1);
+
+    _nodes[idx].offset = right;
+    _nodes[idx].count  = 0;
+    return idx;
+}
+
+const std::vector<BVH::Node>& BVH::GetNodes() const {
+    return _nodes;
+}
+
+const std::vector<int>& BVH::GetIndices() const {
+    return _indices;
+}
+
+std::vector<int> BVH::Linearize() {
+    std::vector<int> order = std::move(_indices);
+    _indices.resize(order.size());
+    std::iota(_indices.begin(), _indices.end(), 0);
+    Link();
+    return order;
+}
+
+std::vector<int> BVH::Refit(const std::vector<int>&  primitives,
+                            const std::vector<AABB>& bounds) {
+    // NB: Children are stored after their parents, so visiting nodes in
+    // decreasing order refits every child before its parent.
+    std::priority_queue<int> queue;
+    for (int p : primitives) {
+        queue.push(_leaves[p]);
+    }
+
+    std::vector<int> changed;
+    int last = -1;
+    while (!queue.empty()) {
+        const int n = queue.top();
+        queue.pop();
+        if (n == last) {
+            continue;
+        }
+        last = n;
+
+        auto& node = _nodes[n];
+        AABB box;
+        if (node.count > 0) {
+            for (int i = node.offset; i < node.offset + node.count; ++i) {
+                box.Extend(bounds[_indices[i]]);
+            }
+        } else {
+            box.Extend(_nodes[n + 1].bounds);
+            box.Extend(_nodes[node.offset].bounds);
+        }
+
+        if (IsSame(box, node.bounds)) {
+            continue;
+        }
+
+        _weighted_area -= WeightedArea(node);
+        node.bounds = box;
+        _weighted_area += WeightedArea(node);
+
+        changed.push_back(n);
+        if (_parents[n] >= 0) {
+            queue.push(_parents[n]);
+        }
+    }
+    return changed;
+}
+
+double BVH::GetCost() const {
+    const double area = GetBounds().SurfaceArea();
+    return area > 0 ? _weighted_area / area : 0.0;
+}
+
+double BVH::GetDegradation() const {
+    return _build_cost > 0 ? GetCost() / _build_cost : 1.0;
+}
+
+AABB BVH::GetBounds() const {
+    return _nodes.empty() ? AABB{} : _nodes[0].bounds;
+}
+
+/* ############################################# Packet traversal ############################################# */
+
+PacketInterval MakePacketInterval(const RayPacket& packet, RayPacket::Mask active) {
+    PacketInterval interval;
+    AABB orig, inv;
+    for (int lane = 0; lane < packet.size; ++lane) {
+        if (!(active >> lane & 1)) {
+            continue;
+        }
+        orig.Extend(packet.GetOrig(lane));
+        inv.Extend(Vec3f{packet.ix[lane], packet.iy[lane], packet.iz[lane]});
+    }
+
+    // NB: Entry and exit planes are the same for every lane only if
+    // direction signs agree, axis parallel rays are left to lane tests.
+    for (int axis = 0; axis < 3; ++axis) {
+        const double lo = Axis(inv.lo, axis);
+        const double hi = Axis(inv.hi, axis);
+        if (!std::isfinite(lo) || !std::isfinite(hi) || (lo < 0 && hi > 0)) {
+            interval.valid = false;
+        }
+    }
+
+    interval.orig_lo = orig.lo;
+    interval.orig_hi = orig.hi;
+    interval.inv_lo  = inv.lo;
+    interval.inv_hi  = inv.hi;
+    return interval;
+}
+
+bool IsCulled(const PacketInterval& interval, const AABB& box, double tmax) {
+    double entry = 0;
+    double exit  = tmax;
+    for (int axis = 0; axis < 3; ++axis) {
+        const double olo = Axis(interval.orig_lo, axis);
+        const double ohi = Axis(interval.orig_hi, axis);
+        const double ilo = Axis(interval.inv_lo,  axis);
+        const double ihi = Axis(interval.inv_hi,  axis);
+
+        const bool   positive = ilo > 0;
+        const double near = positive ? Axis(box.lo, axis) : Axis(box.hi, axis);
+        const double far  = positive ? Axis(box.hi, axis) : Axis(box.lo, axis);
+
+        // NB: Interval products [near - o] * [inv] and [far - o] * [inv].
+        const double n0 = (near - ohi) * ilo, n1 = (near - ohi) * ihi;
+        const double n2 = (near - olo) * ilo, n3 = (near - olo) * ihi;
+        const double f0 = (far  - ohi) * ilo, f1 = (far  - ohi) * ihi;
+        const double f2 = (far  - olo) * ilo, f3 = (far  - olo) * ihi;
+
+        entry = std::max(entry, std::min({n0, n1, n2, n3}));
+        exit  = std::min(exit,  std::max({f0, f1, f2, f3}));
+    }
+    return entry > exit;
+}
+
+RayPacket::Mask IntersectLanes(const AABB& box, const RayPacket& packet,
+                               RayPacket::Mask active, const double* tmax,
+                               double* tnear) {
+    // NB: Branch-free version of AABB::Intersect over all lanes,
+    // so the loop can be vectorized.
+    double t0[RayPacket::kMaxSize];
+    bool   hit[RayPacket::kMaxSize];
+
+    for (int lane = 0; lane < packet.size; ++lane) {
+        double lo = 0;
+        double hi = tmax[lane];
+
+        auto slab = [&](double blo, double bhi, double o, double inv) {
+            double a = (blo - o) * inv;
+            double b = (bhi - o) * inv;
+            double tlo = a > b ? b : a;
+            double thi = a > b ? a : b;
+            lo = tlo > lo ? tlo : lo;
+            hi = thi < hi ? thi : hi;
+        };
+
+        slab(box.lo.x, box.hi.x, packet.ox[lane], packet.ix[lane]);
+        slab(box.lo.y, box.hi.y, packet.oy[lane], packet.iy[lane]);
+        slab(box.lo.z, box.hi.z, packet.oz[lane], packet.iz[lane]);
+
+        t0[lane]  = lo;
+        hit[lane] = lo <= hi;
+    }
+
+    RayPacket::Mask mask = 0;
+    double closest = std::numeric_limits<double>::max();
+    for (int lane = 0; lane < packet.size; ++lane) {
+        if ((active >> lane & 1) && hit[lane]) {
+            mask |= RayPacket::Mask{1} << lane;
+            closest = std::min(closest, t0[lane]);
+        }
+    }
+    *tnear = closest;
+    return mask;
+}
+
+TraversalCounters& GetTraversalCounters() {
+    static thread_local TraversalCounters counters;
+    return counters;
+}
@@ -0,0 +1,182 @@
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+
+#include <raytracer/checkpoint.hpp>
+
+static constexpr char     kMagic[4] = {'R', 'T', 'C', 'K'};
+static constexpr uint32_t kVersion  = 1;
+
+using File = std::unique_ptr<FILE, int (*)(FILE*)>;
+
+// NB: Calls f(x0, y0, x1, y1) for every finished tile in order.
+template <typename F>
+static void ForDoneTiles(const Checkpoint& checkpoint, F&& f) {
+    const int size    = checkpoint.tile_size;
+    const int tiles_x = (checkpoint.width + size - 1) / size;
+    for (size_t k = 0; k < checkpoint.done.size(); ++k) {
+        if (!checkpoint.done[k]) {
+            continue;
+        }
+        const int x0 = static_cast<int>(k % tiles_x) * size;
+        const int y0 = static_cast<int>(k / tiles_x) * size;
+        f(x0, y0, std::min(x0 + size, checkpoint.width), std::min(y0 + size, checkpoint.height));
+    }
+}
+
+static void Write(FILE* fp, const void* data, size_t size, const std::string& path) {
+    if (std::fwrite(data, 1, size, fp) != size) {
+        throw std::runtime_error("Can't write file " + path);
+    }
+}
+
+static void Read(FILE* fp, void* data, size_t size, const std::string& path) {
+    if (std::fread(data, 1, size, fp) != size) {
+        throw std::runtime_error("Truncated checkpoint " + path);
+    }
+}
+
+void WriteCheckpoint(const std::string& path, const Checkpoint& checkpoint, const Matf& radiance) {
+    const std::string tmp = path + ".tmp";
+    {
+        File fp(std::fopen(tmp.c_str(), "wb"), &std::fclose);
+        if (!fp) {
+            throw std::runtime_error("Can't open file " + tmp);
+        }
+
+        const int32_t  header[3]   = {checkpoint.width, checkpoint.height, checkpoint.tile_size};
+        const uint32_t num_tiles   = static_cast<uint32_t>(checkpoint.done.size());
+        Write(fp.get(), kMagic, sizeof(kMagic), tmp);
+        Write(fp.get(), &kVersion, sizeof(kVersion), tmp);
+        Write(fp.get(), header, sizeof(header), tmp);
+        Write(fp.get(), &checkpoint.fingerprint, sizeof(checkpoint.fingerprint), tmp);
+        Write(fp.get(), &num_tiles, sizeof(num_tiles), tmp);
+        Write(fp.get(), checkpoint.done.data(), checkpoint.done.size(), tmp);
+
+        std::vector<double> row;
+        ForDoneTiles(checkpoint, [&](int x0, int y0, int x1, int y1) {
+            for (int y = y0; y < y1; ++y) {
+                row.clear();
+                for (int x = x0; x < x1; ++x) {
+                    const auto& v = radiance(x, y);
+                    row.insert(row.end(), {v.x, v.y, v.z});
+                }
+                Write(fp.get(), row.data(), row.size() * sizeof(double), tmp);
+            }
+        });
+
+        if (std::fflush(fp.get()) != 0) {
+            throw std::runtime_error("Can't write file " + tmp);
+        }
+    }
+
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("Can't replace file " + path);
+    }
+}
+
+bool ReadCheckpoint(const std::string& path, Checkpoint* checkpoint, Matf* radiance) {
+    File fp(std::fopen(path.c_str(), "rb"), &std::fclose);
+    if (!fp) {
+        return false;
+    }
+
+    char     magic[4];
+    uint32_t version   = 0;
+    int32_t  header[3] = {};
+    uint32_t num_tiles = 0;
+    Read(fp.get(), magic, sizeof(magic), path);
+    Read(fp.get(), &version, sizeof(version), path);
+    if (std::memcmp(magic, kMagic, sizeof(kMagic)) != 0 || version != kVersion) {
+        throw std::runtime_error("Not a checkpoint " + path);
+    }
+    Read(fp.get(), header, sizeof(header), path);
+    Read(fp.get(), &checkpoint->fingerprint, sizeof(checkpoint->fingerprint), path);
+    Read(fp.get(), &num_tiles, sizeof(num_tiles), path);
+
+    checkpoint->width     = header[0];
+    checkpoint->height    = header[1];
+    checkpoint->tile_size = header[2];
+    if (checkpoint->tile_size <= 0 ||
+        static_cast<int>(radiance->GetW()) != checkpoint->width ||
+        static_cast<int>(radiance->GetH()) != checkpoint->height) {
+        throw std::runtime_error("Checkpoint size mismatch " + path);
+    }
+
+    const int64_t tiles_x = (checkpoint->width + checkpoint->tile_size - 1) / checkpoint->tile_size;
+    const int64_t tiles_y = (checkpoint->height + checkpoint->tile_size - 1) / checkpoint->tile_size;
+    if (num_tiles != tiles_x * tiles_y) {
+        throw std::runtime_error("Checkpoint size mismatch " + path);
+    }
+
+    checkpoint->done.resize(num_tiles);
+    Read(fp.get(), checkpoint->done.data(), num_tiles, path);
+
+    std::vector<double> row;
+    ForDoneTiles(*checkpoint, [&](int x0, int y0, int x1, int y1) {
+        row.resize(static_cast<size_t>(x1 - x0) * 3);
+        for (int y = y0; y < y1; ++y) {
+            Read(fp.get(), row.data(), row.size() * sizeof(double), path);
+            for (int x = x0; x < x1; ++x) {
+                const double* v = &row[static_cast<size_t>(x - x0) * 3];
+                (*radiance)(x, y) = Vec3f{v[0], v[1], v[2]};
+            }
+        }
+    });
+    return true;
+}
+
+// NB: FNV-1a.
+uint64_t CheckpointFingerprint(const Scene&         scene,
+                               const CameraOptions& camera_options,
+                               const RenderOptions& render_options) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    auto add = [&](const void* data, size_t size) {
+        const auto* bytes = static_cast<const unsigned char*>(data);
+        for (size_t k = 0; k < size; ++k) {
+            hash = (hash ^ bytes[k]) * 0x100000001b3ull;
+        }
+    };
+    auto add_vec = [&](const Vec3f& v) {
+        add(&v.x, sizeof(v.x));
+        add(&v.y, sizeof(v.y));
+        add(&v.z, sizeof(v.z));
+    };
+
+    add(&camera_options.screen_width, sizeof(camera_options.screen_width));
+    add(&camera_options.screen_height, sizeof(camera_options.screen_height));
+    add(&camera_options.fov, sizeof(camera_options.fov));
+    add(camera_options.look_from.data(), sizeof(double) * 3);
+    add(camera_options.look_to.data(), sizeof(double) * 3);
+    add(&render_options.depth, sizeof(render_options.depth));
+    add(&render_options.tile_size, sizeof(render_options.tile_size));
+    add(&render_options.min_throughput, sizeof(render_options.min_throughput));
+    add(&render_options.russian_roulette, sizeof(render_options.russian_roulette));
+
+    // NB: The scene through the bounds and materials of its objects and its
+    // lights, so a changed file doesn't resume with the old radiance.
+    const size_t num_objects = scene.GetObjects().size();
+    add(&num_objects, sizeof(num_objects));
+    for (const auto& obj : scene.GetObjects()) {
+        const auto box = obj->GetBounds();
+        add_vec(box.lo);
+        add_vec(box.hi);
+        const auto& m = obj->GetMaterial();
+        for (const auto* v : {&m.Ka, &m.Ke, &m.Kd, &m.Ks, &m.Tf}) {
+            add_vec(*v);
+        }
+        for (const double* x : {&m.d, &m.Tr, &m.Ns, &m.Ni}) {
+            add(x, sizeof(*x));
+        }
+        add(&m.illum, sizeof(m.illum));
+    }
+    const size_t num_lights = scene.GetLights().size();
+    add(&num_lights, sizeof(num_lights));
+    for (const auto& light : scene.GetLights()) {
+        add_vec(light.position);
+        add_vec(light.intensity);
+    }
+    return hash;
+}
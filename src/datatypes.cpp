@@ -66,10 +66,98 @@ Vec3f Vec3f::normalize(double l) const {
     return (*this) * (l / norm());
 }
 
+/* ############################################# Transform Implementation ##################################### */
+
+Transform Transform::Identity() {
+    return Transform{{{1, 0, 0, 0},
+                      {0, 1, 0, 0},
+                      {0, 0, 1, 0}}};
+}
+
+Transform Transform::Translate(const Vec3f& t) {
+    return Transform{{{1, 0, 0, t.x},
+                      {0, 1, 0, t.y},
+                      {0, 0, 1, t.z}}};
+}
+
+Transform Transform::Scale(const Vec3f& s) {
+    return Transform{{{s.x, 0,   0,   0},
+                      {0,   s.y, 0,   0},
+                      {0,   0,   s.z, 0}}};
+}
+
+Transform Transform::Rotate(const Vec3f& axis, double angle) {
+    // NB: Rodrigues' rotation formula.
+    const auto   a = axis.normalize();
+    const double c = std::cos(angle);
+    const double s = std::sin(angle);
+    const double t = 1 - c;
+    return Transform{{{t * a.x * a.x + c,       t * a.x * a.y - s * a.z, t * a.x * a.z + s * a.y, 0},
+                      {t * a.x * a.y + s * a.z, t * a.y * a.y + c,       t * a.y * a.z - s * a.x, 0},
+                      {t * a.x * a.z - s * a.y, t * a.y * a.z + s * a.x, t * a.z * a.z + c,       0}}};
+}
+
+Transform Transform::operator*(const Transform& rhs) const {
+    Transform res{};
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            res.m[i][j] = m[i][0] * rhs.m[0][j] + m[i][1] * rhs.m[1][j] + m[i][2] * rhs.m[2][j];
+        }
+        res.m[i][3] += m[i][3];
+    }
+    return res;
+}
+
+Transform Transform::Inverse() const {
+    // NB: Inverse of the linear part by cofactors, then the translation.
+    const double det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+                       m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+                       m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+    const double inv_det = 1 / det;
+
+    Transform res{};
+    res.m[0][0] =  (m[1][1] * m[2][2] - m[1][2] * m[2][1]) * inv_det;
+    res.m[0][1] = -(m[0][1] * m[2][2] - m[0][2] * m[2][1]) * inv_det;
+    res.m[0][2] =  (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * inv_det;
+    res.m[1][0] = -(m[1][0] * m[2][2] - m[1][2] * m[2][0]) * inv_det;
+    res.m[1][1] =  (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * inv_det;
+    res.m[1][2] = -(m[0][0] * m[1][2] - m[0][2] * m[1][0]) * inv_det;
+    res.m[2][0] =  (m[1][0] * m[2][1] - m[1][1] * m[2][0]) * inv_det;
+    res.m[2][1] = -(m[0][0] * m[2][1] - m[0][1] * m[2][0]) * inv_det;
+    res.m[2][2] =  (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * inv_det;
+
+    const auto t = res.Vector(Vec3f{m[0][3], m[1][3], m[2][3]});
+    res.m[0][3] = -t.x;
+    res.m[1][3] = -t.y;
+    res.m[2][3] = -t.z;
+    return res;
+}
+
+Vec3f Transform::Point(const Vec3f& p) const {
+    return Vector(p) + Vec3f{m[0][3], m[1][3], m[2][3]};
+}
+
+Vec3f Transform::Vector(const Vec3f& v) const {
+    return Vec3f{m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z,
+                 m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z,
+                 m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z};
+}
+
+Vec3f Transform::TransposedVector(const Vec3f& v) const {
+    return Vec3f{m[0][0] * v.x + m[1][0] * v.y + m[2][0] * v.z,
+                 m[0][1] * v.x + m[1][1] * v.y + m[2][1] * v.z,
+                 m[0][2] * v.x + m[1][2] * v.y + m[2][2] * v.z};
+}
+
 /* ############################################# Matf Implementation ######################################## */
 
+// NB: Vec3f is 24 bytes, so 8 of them are a multiple of a cache line.
+static constexpr size_t kStrideAlignment = 8;
+static_assert(sizeof(Vec3f) * kStrideAlignment % Matf::kAlignment == 0);
+
 Matf::Matf(size_t w, size_t h)
-    : width(w), height(h), data(w, std::vector<Vec3f>(h)) {
+    : width(w), height(h), stride((w + kStrideAlignment - 1) / kStrideAlignment * kStrideAlignment),
+      data(stride * h) {
 }
 
 size_t Matf::GetW() const {
@@ -80,10 +168,14 @@ size_t Matf::GetH() const {
     return height;
 }
 
-std::vector<Vec3f>& Matf::operator[](int i) {
-    return data[i];
+size_t Matf::GetStride() const {
+    return stride;
+}
+
+Vec3f* Matf::Row(size_t y) {
+    return data.data() + y * stride;
 }
 
-const std::vector<Vec3f>& Matf::operator[](int i) const {
-    return data[i];
+const Vec3f* Matf::Row(size_t y) const {
+    return data.data() + y * stride;
 }
@@ -1,11 +1,55 @@
+#include <chrono>
+#include <numeric>
+#include <cstring>
+#include <algorithm>
+#include <unordered_set>
+
 #include <raytracer/geometry.hpp>
 
+// NB: Calls f(first, count, tmax) for every leaf of the selected tree
+// entered by the ray, where first and count address the BVH indices.
+template <typename F>
+static void TraverseLeaves(BVHLayout         layout,
+                           const BVH&        bvh,
+                           const WideBVH<4>& bvh4,
+                           const WideBVH<8>& bvh8,
+                           const Ray&        ray,
+                           double            tmax,
+                           F&&               f) {
+    switch (layout) {
+        case BVHLayout::kWide4:
+            bvh4.TraverseLeaves(ray.orig, ray.dir, tmax, f);
+            break;
+        case BVHLayout::kWide8:
+            bvh8.TraverseLeaves(ray.orig, ray.dir, tmax, f);
+            break;
+        default: {
+            const auto& nodes = bvh.GetNodes();
+            bvh.TraverseLeaves(ray.orig, ray.dir, tmax, [&](int node, double& tlimit) {
+                return f(nodes[node].offset, nodes[node].count, tlimit);
+            });
+        }
+    }
+}
+
 Scene::Scene(Objects&&                      objects,
              Lights&&                       lights,
              std::vector<GeometricVertex>&& geom_vertices)
     : _objects(std::move(objects)),
       _lights(std::move(lights)),
       _geom_vertices(std::move(geom_vertices)) {
+    using namespace std::chrono;
+    auto start = high_resolution_clock::now();
+
+    _bounds.reserve(_objects.size());
+    for (const auto& obj : _objects) {
+        obj->Commit();
+        _bounds.push_back(obj->GetBounds());
+    }
+    _bvh = BVH{_bounds};
+
+    auto end = high_resolution_clock::now();
+    _build_time = duration<double, std::milli>(end - start).count();
 }
 
 const Objects& Scene::GetObjects() const {
@@ -20,10 +64,128 @@ const std::vector<GeometricVertex>& Scene::GetGeometricVertices() const {
     return _geom_vertices;
 }
 
+const BVH& Scene::GetBVH() const {
+    return _bvh;
+}
+
+BVHLayout Scene::GetBVHLayout() const {
+    return _layout;
+}
+
+void Scene::SetBVHLayout(BVHLayout layout) {
+    using namespace std::chrono;
+    auto start = high_resolution_clock::now();
+
+    _layout = layout;
+    _bvh4   = layout == BVHLayout::kWide4 ? WideBVH<4>{_bvh} : WideBVH<4>{};
+    _bvh8   = layout == BVHLayout::kWide8 ? WideBVH<8>{_bvh} : WideBVH<8>{};
+    // NB: Prototypes are switched once however many instances share them.
+    std::unordered_set<Object*> prototypes;
+    for (const auto& obj : _objects) {
+        obj->SetBVHLayout(layout);
+        for (auto instance = dynamic_cast<const Instance*>(obj.get()); instance;) {
+            Object* prototype = instance->GetPrototype().get();
+            if (!prototypes.insert(prototype).second) {
+                break;
+            }
+            prototype->SetBVHLayout(layout);
+            instance = dynamic_cast<const Instance*>(prototype);
+        }
+    }
+
+    auto end = high_resolution_clock::now();
+    _build_time += duration<double, std::milli>(end - start).count();
+}
+
+void Scene::Refit(const std::vector<int>& objects) {
+    using namespace std::chrono;
+    auto start = high_resolution_clock::now();
+
+    for (int idx : objects) {
+        _bounds[idx] = _objects[idx]->GetBounds();
+    }
+
+    auto changed = _bvh.Refit(objects, _bounds);
+    if (_bvh.GetDegradation() > BVH::kRebuildThreshold) {
+        _bvh  = BVH{_bounds};
+        _bvh4 = _layout == BVHLayout::kWide4 ? WideBVH<4>{_bvh} : WideBVH<4>{};
+        _bvh8 = _layout == BVHLayout::kWide8 ? WideBVH<8>{_bvh} : WideBVH<8>{};
+    } else if (_layout == BVHLayout::kWide4) {
+        _bvh4.Refit(_bvh, changed);
+    } else if (_layout == BVHLayout::kWide8) {
+        _bvh8.Refit(_bvh, changed);
+    }
+
+    auto end = high_resolution_clock::now();
+    _build_time += duration<double, std::milli>(end - start).count();
+}
+
+double Scene::GetBuildTime() const {
+    return _build_time;
+}
+
 void Scene::AddLight(Light &&light) {
     _lights.push_back(std::move(light));
 }
 
+std::optional<Intersection> Scene::Intersect(const Ray& ray, double tmax) const {
+    std::optional<Intersection> closest;
+    const auto& indices = _bvh.GetIndices();
+
+    TraverseLeaves(_layout, _bvh, _bvh4, _bvh8, ray, tmax,
+            [&](int first, int count, double& tlimit) {
+                for (int i = first; i < first + count; ++i) {
+                    const auto& obj = _objects[indices[i]];
+                    auto isect = obj->intersect(ray, tlimit);
+                    if (isect) {
+                        tlimit  = isect->distance;
+                        closest = isect;
+                        closest->object = obj.get();
+                    }
+                }
+                return false;
+            });
+
+    return closest;
+}
+
+RayPacket::Mask Scene::Intersect(const RayPacket& packet, Intersection* hits) const {
+    double tmax[RayPacket::kMaxSize];
+    std::fill(tmax, tmax + packet.size, kInfinity);
+
+    RayPacket::Mask hit_mask = 0;
+    _bvh.TraversePacket(packet, packet.GetMask(), tmax,
+            [&](int node, RayPacket::Mask mask, double* tlimit) {
+                const auto& leaf = _bvh.GetNodes()[node];
+                for (int i = leaf.offset; i < leaf.offset + leaf.count; ++i) {
+                    const auto& obj = _objects[_bvh.GetIndices()[i]];
+                    auto closer = obj->intersect(packet, mask, tlimit, hits);
+                    for (int lane = 0; lane < packet.size; ++lane) {
+                        if (closer >> lane & 1) {
+                            hits[lane].object = obj.get();
+                        }
+                    }
+                    hit_mask |= closer;
+                }
+            });
+
+    return hit_mask;
+}
+
+bool Scene::Occluded(const Ray& ray, double tmax) const {
+    bool occluded = false;
+    const auto& indices = _bvh.GetIndices();
+
+    TraverseLeaves(_layout, _bvh, _bvh4, _bvh8, ray, tmax,
+            [&](int first, int count, double& tlimit) {
+                for (int i = first; i < first + count && !occluded; ++i) {
+                    occluded = _objects[indices[i]]->occluded(ray, tlimit);
+                }
+                return occluded;
+            });
+    return occluded;
+}
+
 Vec3f Ray::at(double t) const {
     return orig + dir * t;
 }
@@ -56,6 +218,96 @@ Vec3f CalculateAffine(const Vec3f& a,
     return a * uvw.x + b * uvw.y + c * uvw.z;
 }
 
+Instance::Instance(Object::Ptr prototype, const Transform& transform)
+    : Object(prototype->GetMaterial()),
+      _prototype(std::move(prototype)),
+      _transform(transform),
+      _inverse(transform.Inverse()) {
+}
+
+Ray Instance::ToObject(const Ray& ray, double* scale) const {
+    Vec3f dir = _inverse.Vector(ray.dir);
+    *scale = dir.length();
+    return Ray{_inverse.Point(ray.orig), dir / *scale};
+}
+
+std::optional<Intersection> Instance::intersect(const Ray& ray, double tmax) {
+    double scale;
+    const auto local = ToObject(ray, &scale);
+    const double local_tmax = tmax == kInfinity ? kInfinity : tmax * scale;
+
+    auto isect = _prototype->intersect(local, local_tmax);
+    if (!isect) {
+        return {};
+    }
+    isect->distance /= scale;
+    // NB: Rounding might bring the hit back beyond tmax.
+    if (!(isect->distance < tmax)) {
+        return {};
+    }
+    return isect;
+}
+
+HitInfo Instance::GetHitInfo(const Ray& ray, const Intersection& isect) const {
+    double scale;
+    const auto local = ToObject(ray, &scale);
+
+    auto local_isect     = isect;
+    local_isect.distance = isect.distance * scale;
+    local_isect.object   = _prototype.get();
+
+    auto hit     = _prototype->GetHitInfo(local, local_isect);
+    hit.position = _transform.Point(hit.position);
+    hit.normal   = _inverse.TransposedVector(hit.normal).normalize();
+    hit.distance = isect.distance;
+    return hit;
+}
+
+bool Instance::occluded(const Ray& ray, double tmax) {
+    double scale;
+    const auto local = ToObject(ray, &scale);
+    return _prototype->occluded(local, tmax == kInfinity ? kInfinity : tmax * scale);
+}
+
+AABB Instance::GetBounds() const {
+    // NB: From the current prototype bounds, which change with its geometry.
+    const auto box = _prototype->GetBounds();
+    AABB bounds;
+    for (int corner = 0; corner < 8; ++corner) {
+        bounds.Extend(_transform.Point(Vec3f{corner & 1 ? box.hi.x : box.lo.x,
+                                             corner & 2 ? box.hi.y : box.lo.y,
+                                             corner & 4 ? box.hi.z : box.lo.z}));
+    }
+    return bounds;
+}
+
+const Object::Ptr& Instance::GetPrototype() const {
+    return _prototype;
+}
+
+const Transform& Instance::GetTransform() const {
+    return _transform;
+}
+
+RayPacket::Mask Object::intersect(const RayPacket& packet,
+                                  RayPacket::Mask  active,
+                                  double*          tmax,
+                                  Intersection*    hits) {
+    RayPacket::Mask closer = 0;
+    for (int lane = 0; lane < packet.size; ++lane) {
+        if (!(active >> lane & 1)) {
+            continue;
+        }
+        auto isect = intersect(Ray{packet.GetOrig(lane), packet.GetDir(lane)}, tmax[lane]);
+        if (isect) {
+            tmax[lane] = isect->distance;
+            hits[lane] = isect.value();
+            closer |= RayPacket::Mask{1} << lane;
+        }
+    }
+    return closer;
+}
+
 const Material& Object::GetMaterial() const {
     return material;
 }
@@ -68,8 +320,8 @@ Sphere::Sphere(Vec3f center, double radius, const Material m)
     : Object(m), c(center), r(radius) {
 };
 
-std::optional<HitInfo> Sphere::intersect(const Ray& ray) {
-    // Geometric solution
+// NB: Geometric solution, returns distance to the nearest hit in front of the ray.
+static std::optional<double> IntersectSphere(const Vec3f& c, double r, const Ray& ray) {
     Vec3f L = c - ray.orig;
 
     double tca = L.dot(ray.dir);
@@ -100,82 +352,368 @@ std::optional<HitInfo> Sphere::intersect(const Ray& ray) {
         return {};
     }
 
-    Vec3f phit = ray.at(distance);
+    return distance;
+}
+
+std::optional<Intersection> Sphere::intersect(const Ray& ray, double tmax) {
+    auto distance = IntersectSphere(c, r, ray);
+    if (!distance || distance.value() >= tmax) {
+        return {};
+    }
+    return Intersection{distance.value()};
+}
+
+HitInfo Sphere::GetHitInfo(const Ray& ray, const Intersection& isect) const {
+    Vec3f phit = ray.at(isect.distance);
     Vec3f N = (phit - c).normalize();
 
-    return HitInfo{phit, N, distance};
+    HitInfo hit{phit, N, isect.distance};
+    hit.material = &material;
+    return hit;
 }
 
-Triangle::Triangle(const std::array<GeometricVertex, 3>&  v,
-                   const Material&                        m,
-                   const Triangle::OA<TextureVertex>      vt,
-                   const Triangle::OA<VertexNormal>       vn)
-    : Object(m), geom_vertices(v), texture_vertices(vt), vertex_normals(vn) {
+bool Sphere::occluded(const Ray& ray, double tmax) {
+    auto distance = IntersectSphere(c, r, ray);
+    return distance && distance.value() < tmax;
 }
 
-std::optional<HitInfo> Triangle::intersect(const Ray& ray) {
-    constexpr double kEpsilon = 1e-8;
-    double u, v, w;
+AABB Sphere::GetBounds() const {
+    Vec3f ext{r, r, r};
+    return AABB{c - ext, c + ext};
+}
 
-    Vec3f v0{geom_vertices[0].x, geom_vertices[0].y, geom_vertices[0].z};
-    Vec3f v1{geom_vertices[1].x, geom_vertices[1].y, geom_vertices[1].z};
-    Vec3f v2{geom_vertices[2].x, geom_vertices[2].y, geom_vertices[2].z};
+void Sphere::SetGeometry(const Vec3f& center, double radius) {
+    c = center;
+    r = radius;
+}
 
-    Vec3f v0v1 = v1 - v0;
-    Vec3f v0v2 = v2 - v0;
+bool IntersectTriangle(const TriangleRecord& tri,
+                       const Ray&            ray,
+                       double*               t,
+                       double*               u,
+                       double*               v) {
+    // NB: Moller-Trumbore ray-triangle intersection.
+    constexpr double kEpsilon = 1e-8;
 
-    Vec3f pvec = ray.dir.cross(v0v2);
+    Vec3f pvec = ray.dir.cross(tri.e2);
 
-    double det = v0v1.dot(pvec);
+    double det = tri.e1.dot(pvec);
 
     // ray and triangle are parallel if det is close to 0
     if (std::fabs(det) < kEpsilon) {
-        return {};
+        return false;
     }
 
     double invDet = 1 / det;
 
-    Vec3f tvec = ray.orig - v0;
-    u = tvec.dot(pvec) * invDet;
-    if (u < 0 || u > 1) {
-        return {};
+    Vec3f tvec = ray.orig - tri.v0;
+    *u = tvec.dot(pvec) * invDet;
+    if (*u < 0 || *u > 1) {
+        return false;
     }
 
-    Vec3f qvec = tvec.cross(v0v1);
-    v = ray.dir.dot(qvec) * invDet;
-    if (v < 0 || u + v > 1) {
-        return {};
+    Vec3f qvec = tvec.cross(tri.e1);
+    *v = ray.dir.dot(qvec) * invDet;
+    if (*v < 0 || *u + *v > 1) {
+        return false;
     }
 
-    double t = v0v2.dot(qvec) * invDet;
-    auto P = ray.at(t);
+    *t = tri.e2.dot(qvec) * invDet;
 
     // FIXME: From where this nan appears ???
-    if (t < 0 || std::isnan(t)) {
-        return {};
+    if (*t < 0 || std::isnan(*t)) {
+        return false;
     }
+    return true;
+}
+
+Vec3f MeshBuffers::GetPosition(int i) const {
+    return {px[i], py[i], pz[i]};
+}
+
+Vec3f MeshBuffers::GetNormal(int i) const {
+    return {nx[i], ny[i], nz[i]};
+}
+
+Vec3f MeshBuffers::GetTexture(int i) const {
+    return {tu[i], tv[i], 0.0};
+}
+
+TriangleMesh::TriangleMesh(std::shared_ptr<const MeshBuffers> buffers,
+                           MeshIndices&&                      indices,
+                           const Material&                    m)
+    : Object(m), _buffers(std::move(buffers)), _indices(std::move(indices)) {
+}
 
-    Vec3f N = v0v1.cross(v0v2).normalize();
+static void Permute(std::vector<int>* indices, const std::vector<int>& order) {
+    if (indices->empty()) {
+        return;
+    }
+    std::vector<int> permuted(indices->size());
+    for (int i = 0; i < order.size(); ++i) {
+        for (int k = 0; k < 3; ++k) {
+            permuted[3 * i + k] = (*indices)[3 * order[i] + k];
+        }
+    }
+    *indices = std::move(permuted);
+}
+
+std::vector<AABB> TriangleMesh::GetTriangleBounds() const {
+    const auto& buf = *_buffers;
+    std::vector<AABB> bounds(GetTriangleCount());
+    for (int tri = 0; tri < GetTriangleCount(); ++tri) {
+        for (int k = 0; k < 3; ++k) {
+            bounds[tri].Extend(buf.GetPosition(_indices.v[3 * tri + k]));
+        }
+    }
+    return bounds;
+}
+
+void TriangleMesh::Commit() {
+    _bvh = BVH{GetTriangleBounds()};
+
+    // NB: Store triangles in leaf order, so a leaf reads adjacent packets.
+    const auto order = _bvh.Linearize();
+    Permute(&_indices.v,  order);
+    Permute(&_indices.vt, order);
+    Permute(&_indices.vn, order);
+
+    Update();
+    // NB: The wide trees are collapsed from the new binary one.
+    SetBVHLayout(_layout);
+}
 
-    w = (1 - u - v);
-    if (vertex_normals && !material.map_bump) {
-        const auto& normals = vertex_normals.value();
-        Vec3f v0n{normals[0].i, normals[0].j, normals[0].k};
-        Vec3f v1n{normals[1].i, normals[1].j, normals[1].k};
-        Vec3f v2n{normals[2].i, normals[2].j, normals[2].k};
+void TriangleMesh::SetBuffers(std::shared_ptr<const MeshBuffers> buffers) {
+    _buffers = std::move(buffers);
 
-        N = (u * v0n.normalize() +
-             v * v1n.normalize() +
-             w * v2n.normalize()).normalize();
+    // NB: Triangles are numbered in leaf order since Commit.
+    std::vector<int> triangles(GetTriangleCount());
+    std::iota(triangles.begin(), triangles.end(), 0);
+    auto changed = _bvh.Refit(triangles, GetTriangleBounds());
+    if (_bvh.GetDegradation() > BVH::kRebuildThreshold) {
+        Commit();
+        return;
     }
 
-    HitInfo hit{P, N, t};
-    if (texture_vertices) {
-        const auto  bary = CalculateBarycentric(v0, v1, v2, P);
-        const auto& vts  = texture_vertices.value();
-        Vec3f vt0{vts[0].u, vts[0].v, vts[0].w};
-        Vec3f vt1{vts[1].u, vts[1].v, vts[1].w};
-        Vec3f vt2{vts[2].u, vts[2].v, vts[2].w};
+    Update();
+    _bvh4.Refit(_bvh, changed);
+    _bvh8.Refit(_bvh, changed);
+}
+
+void TriangleMesh::Update() {
+    const auto& buf = *_buffers;
+    const int   num_triangles = GetTriangleCount();
+
+    std::vector<TriangleRecord> records(num_triangles);
+    _normals.resize(num_triangles);
+    for (int tri = 0; tri < num_triangles; ++tri) {
+        Vec3f v0 = buf.GetPosition(_indices.v[3 * tri]);
+        Vec3f v1 = buf.GetPosition(_indices.v[3 * tri + 1]);
+        Vec3f v2 = buf.GetPosition(_indices.v[3 * tri + 2]);
+
+        records[tri]  = TriangleRecord{v0, v1 - v0, v2 - v0};
+        _normals[tri] = records[tri].e1.cross(records[tri].e2).normalize();
+    }
+
+    const auto& nodes = _bvh.GetNodes();
+    _packets.clear();
+    _leaf_packets.assign(num_triangles, -1);
+    for (int n = 0; n < nodes.size(); ++n) {
+        if (nodes[n].count == 0) {
+            continue;
+        }
+        _leaf_packets[nodes[n].offset] = _packets.size();
+        for (int first = 0; first < nodes[n].count; first += TrianglePacket::kWidth) {
+            TrianglePacket packet{};
+            for (int lane = 0; lane < TrianglePacket::kWidth; ++lane) {
+                packet.tri[lane] = -1;
+                if (first + lane >= nodes[n].count) {
+                    continue;
+                }
+                const int   tri = nodes[n].offset + first + lane;
+                const auto& rec = records[tri];
+                packet.tri[lane] = tri;
+                packet.v0x[lane] = rec.v0.x;
+                packet.v0y[lane] = rec.v0.y;
+                packet.v0z[lane] = rec.v0.z;
+                packet.e1x[lane] = rec.e1.x;
+                packet.e1y[lane] = rec.e1.y;
+                packet.e1z[lane] = rec.e1.z;
+                packet.e2x[lane] = rec.e2.x;
+                packet.e2y[lane] = rec.e2.y;
+                packet.e2z[lane] = rec.e2.z;
+            }
+            _packets.push_back(packet);
+        }
+    }
+
+    _tangents.clear();
+    if (!material.map_bump || _indices.vt.empty()) {
+        return;
+    }
+
+    _tangents.resize(num_triangles);
+    for (int tri = 0; tri < num_triangles; ++tri) {
+        if (_indices.vt[3 * tri] < 0) {
+            continue;
+        }
+        Vec3f vt0 = buf.GetTexture(_indices.vt[3 * tri]);
+        Vec3f vt1 = buf.GetTexture(_indices.vt[3 * tri + 1]);
+        Vec3f vt2 = buf.GetTexture(_indices.vt[3 * tri + 2]);
+
+        auto delta_uv1 = vt1 - vt0;
+        auto delta_uv2 = vt2 - vt0;
+        float f = 1.0f / (delta_uv1.x * delta_uv2.y - delta_uv2.x * delta_uv1.y);
+        const auto& edge1 = records[tri].e1;
+        const auto& edge2 = records[tri].e2;
+
+        Vec3f tangent;
+        tangent.x = f * (delta_uv2.y * edge1.x - delta_uv1.y * edge2.x);
+        tangent.y = f * (delta_uv2.y * edge1.y - delta_uv1.y * edge2.y);
+        tangent.z = f * (delta_uv2.y * edge1.z - delta_uv1.y * edge2.z);
+
+        Vec3f bitanget;
+        bitanget.x = f * (-delta_uv2.x * edge1.x + delta_uv1.x * edge2.x);
+        bitanget.y = f * (-delta_uv2.x * edge1.y + delta_uv1.x * edge2.y);
+        bitanget.z = f * (-delta_uv2.x * edge1.z + delta_uv1.x * edge2.z);
+
+        _tangents[tri] = TangentFrame{tangent.normalize(), bitanget.normalize()};
+    }
+}
+
+int TriangleMesh::GetTriangleCount() const {
+    return static_cast<int>(_indices.v.size() / 3);
+}
+
+const std::shared_ptr<const MeshBuffers>& TriangleMesh::GetBuffers() const {
+    return _buffers;
+}
+
+const MeshIndices& TriangleMesh::GetIndices() const {
+    return _indices;
+}
+
+const BVH& TriangleMesh::GetBVH() const {
+    return _bvh;
+}
+
+void TriangleMesh::SetBVHLayout(BVHLayout layout) {
+    _layout = layout;
+    _bvh4   = layout == BVHLayout::kWide4 ? WideBVH<4>{_bvh} : WideBVH<4>{};
+    _bvh8   = layout == BVHLayout::kWide8 ? WideBVH<8>{_bvh} : WideBVH<8>{};
+}
+
+size_t TriangleMesh::GetBVHMemoryUsage() const {
+    switch (_layout) {
+        case BVHLayout::kWide4: return _bvh4.GetMemoryUsage();
+        case BVHLayout::kWide8: return _bvh8.GetMemoryUsage();
+        default:                return _bvh.GetNodes().size() * sizeof(BVH::Node);
+    }
+}
+
+AABB TriangleMesh::GetBounds() const {
+    return _bvh.GetBounds();
+}
+
+std::optional<Intersection> TriangleMesh::intersect(const Ray& ray, double tmax) {
+    std::optional<Intersection> closest;
+
+    TraverseLeaves(_layout, _bvh, _bvh4, _bvh8, ray, tmax,
+            [&](int first_tri, int count, double& tlimit) {
+                const int first = _leaf_packets[first_tri];
+                const int last  = first + (count + TrianglePacket::kWidth - 1) /
+                                          TrianglePacket::kWidth;
+                for (int p = first; p < last; ++p) {
+                    double u, v;
+                    int lane = IntersectPacket(_packets[p], ray, &tlimit, &u, &v);
+                    if (lane >= 0) {
+                        closest = Intersection{tlimit, u, v, _packets[p].tri[lane]};
+                    }
+                }
+                return false;
+            });
+
+    return closest;
+}
+
+RayPacket::Mask TriangleMesh::intersect(const RayPacket& packet,
+                                        RayPacket::Mask  active,
+                                        double*          tmax,
+                                        Intersection*    hits) {
+    RayPacket::Mask closer = 0;
+    const auto& nodes = _bvh.GetNodes();
+
+    _bvh.TraversePacket(packet, active, tmax,
+            [&](int node, RayPacket::Mask mask, double* tlimit) {
+                const int first = _leaf_packets[nodes[node].offset];
+                const int last  = first + (nodes[node].count + TrianglePacket::kWidth - 1) /
+                                          TrianglePacket::kWidth;
+                for (int lane = 0; lane < packet.size; ++lane) {
+                    if (!(mask >> lane & 1)) {
+                        continue;
+                    }
+                    const Ray ray{packet.GetOrig(lane), packet.GetDir(lane)};
+                    for (int p = first; p < last; ++p) {
+                        double u, v;
+                        int hit = IntersectPacket(_packets[p], ray, &tlimit[lane], &u, &v);
+                        if (hit >= 0) {
+                            hits[lane] = Intersection{tlimit[lane], u, v, _packets[p].tri[hit]};
+                            closer |= RayPacket::Mask{1} << lane;
+                        }
+                    }
+                }
+            });
+
+    return closer;
+}
+
+bool TriangleMesh::occluded(const Ray& ray, double tmax) {
+    bool occluded = false;
+
+    TraverseLeaves(_layout, _bvh, _bvh4, _bvh8, ray, tmax,
+            [&](int first_tri, int count, double& tlimit) {
+                const int first = _leaf_packets[first_tri];
+                const int last  = first + (count + TrianglePacket::kWidth - 1) /
+                                          TrianglePacket::kWidth;
+                for (int p = first; p < last && !occluded; ++p) {
+                    double t = tlimit, u, v;
+                    occluded = IntersectPacket(_packets[p], ray, &t, &u, &v) >= 0;
+                }
+                return occluded;
+            });
+
+    return occluded;
+}
+
+HitInfo TriangleMesh::GetHitInfo(const Ray& ray, const Intersection& isect) const {
+    const auto& buf = *_buffers;
+    const int   tri = isect.primitive;
+    const bool  has_vt = !_indices.vt.empty() && _indices.vt[3 * tri] >= 0;
+    const bool  has_vn = !_indices.vn.empty() && _indices.vn[3 * tri] >= 0;
+
+    const double u = isect.u;
+    const double v = isect.v;
+    const double w = 1 - u - v;
+
+    auto P = ray.at(isect.distance);
+    Vec3f N = _normals[tri];
+
+    if (has_vn && !material.map_bump) {
+        Vec3f v0n = buf.GetNormal(_indices.vn[3 * tri]);
+        Vec3f v1n = buf.GetNormal(_indices.vn[3 * tri + 1]);
+        Vec3f v2n = buf.GetNormal(_indices.vn[3 * tri + 2]);
+
+        N = (u * v0n + v * v1n + w * v2n).normalize();
+    }
+
+    HitInfo hit{P, N, isect.distance};
+    hit.material = &material;
+    if (has_vt) {
+        // NB: Moller-Trumbore u and v are the weights of v1 and v2.
+        const Vec3f bary{w, u, v};
+        Vec3f vt0 = buf.GetTexture(_indices.vt[3 * tri]);
+        Vec3f vt1 = buf.GetTexture(_indices.vt[3 * tri + 1]);
+        Vec3f vt2 = buf.GetTexture(_indices.vt[3 * tri + 2]);
         const auto affine = CalculateAffine(vt0, vt1, vt2, bary);
 
         auto reverse_gamma = [](const Vec3f v) {
@@ -207,23 +745,7 @@ std::optional<HitInfo> Triangle::intersect(const Ray& ray) {
         }
 
         if (material.map_bump) {
-            auto delta_uv1 = vt1 - vt0;
-            auto delta_uv2 = vt2 - vt0;
-            float f = 1.0f / (delta_uv1.x * delta_uv2.y - delta_uv2.x * delta_uv1.y);
-            auto edge1 = v0v1;
-            auto edge2 = v0v2;
-
-            Vec3f tangent;
-            tangent.x = f * (delta_uv2.y * edge1.x - delta_uv1.y * edge2.x);
-            tangent.y = f * (delta_uv2.y * edge1.y - delta_uv1.y * edge2.y);
-            tangent.z = f * (delta_uv2.y * edge1.z - delta_uv1.y * edge2.z);
-            tangent = tangent.normalize();
-
-            Vec3f bitanget;
-            bitanget.x = f * (-delta_uv2.x * edge1.x + delta_uv1.x * edge2.x);
-            bitanget.y = f * (-delta_uv2.x * edge1.y + delta_uv1.x * edge2.y);
-            bitanget.z = f * (-delta_uv2.x * edge1.z + delta_uv1.x * edge2.z);
-            bitanget = bitanget.normalize();
+            const auto& frame = _tangents[tri];
 
             auto bump_map = extract_texture_pixel(material.map_bump.value(), affine);
             bump_map = ((bump_map * 2.0) - 1.0).normalize();
@@ -234,7 +756,9 @@ std::optional<HitInfo> Triangle::intersect(const Ray& ray) {
                 N = N * -1;
             }
 
-            Vec3f bump_normal = (bump_map.x  * tangent) + (bump_map.y * bitanget) + (bump_map.z * N);
+            Vec3f bump_normal = (bump_map.x  * frame.tangent) +
+                                (bump_map.y  * frame.bitangent) +
+                                (bump_map.z  * N);
             hit.normal = bump_normal.normalize();
         }
     }
@@ -272,44 +796,61 @@ Vec3f Reflect(const Vec3f& I, const Vec3f& N) {
     return I - (N * 2.f * N.dot(I));
 }
 
-Vec3f Trace(const Ray&     ray,
-            const Scene&   scene,
-            const Options& options,
-            int            depth,
-            bool           outside) {
-    Vec3f background{0.0, 0.0, 0.0};
-    if (depth == options.render_options.depth) {
-        return background;
+static double MaxComponent(const Vec3f& v) {
+    return std::max({v.x, v.y, v.z});
+}
+
+// NB: Uniform number in [0, 1) derived from the ray, so paths don't depend
+// on the thread or order they are traced in.
+static double RouletteNumber(const Ray& ray, int depth) {
+    uint64_t h = static_cast<uint64_t>(depth) * 0x9e3779b97f4a7c15ull;
+    for (double v : {ray.orig.x, ray.orig.y, ray.orig.z, ray.dir.x, ray.dir.y, ray.dir.z}) {
+        uint64_t bits;
+        std::memcpy(&bits, &v, sizeof(bits));
+        h = (h ^ bits) * 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
     }
+    return (h >> 11) * (1.0 / (1ull << 53));
+}
 
-    std::shared_ptr<Object> closest_obj;
-    HitInfo info;
-    double distance = std::numeric_limits<double>::max();
+// NB: Pushes the branch unless its throughput is negligible. With Russian
+// roulette a weak branch survives with probability proportional to its
+// throughput and is reweighted, so the estimate stays unbiased.
+static void PushBranch(std::vector<PathRay>* stack, const Options& options,
+                       const PathRay& entry) {
+    const auto& render_options = options.render_options;
+    if (entry.depth == render_options.depth) {
+        return;
+    }
 
-    for (auto&& obj : scene.GetObjects()) {
-        auto has_hit = obj->intersect(ray);
-        if (!has_hit) {
-            continue;
+    const double throughput = MaxComponent(entry.weight);
+    if (throughput <= 0) {
+        return;
+    }
+    if (throughput < render_options.min_throughput) {
+        if (!render_options.russian_roulette) {
+            return;
         }
-        const auto& hi = has_hit.value();
-
-        if (hi.distance < distance) {
-            closest_obj = obj;
-            info = hi;
-            distance = hi.distance;
+        const double p = throughput / render_options.min_throughput;
+        if (RouletteNumber(entry.ray, entry.depth) >= p) {
+            return;
         }
+        stack->push_back(PathRay{entry.ray, entry.weight / p, entry.depth, entry.outside});
+        return;
     }
+    stack->push_back(entry);
+}
 
-    if (!closest_obj) {
-        return background;
-    }
-
-    const auto& material = closest_obj->GetMaterial();
-    Vec3f diffuse{0.0, 0.0, 0.0};
-    Vec3f specular{0.0, 0.0, 0.0};
-
-    Vec3f Ibase{0.0, 0.0, 0.0};
-    Vec3f Icomp{0.0, 0.0, 0.0};
+SurfaceShading ShadeSurface(const PathRay&            path,
+                            const Intersection&       isect,
+                            const Scene&              scene,
+                            const Options&            options,
+                            std::vector<LightSample>* lights,
+                            std::vector<PathRay>*     branches) {
+    const auto& ray = path.ray;
+    // NB: Shading attributes are evaluated only for the closest hit.
+    const auto  info     = isect.object->GetHitInfo(ray, isect);
+    const auto& material = *info.material;
 
     Vec3f newN = info.normal;
     if (ray.dir.dot(newN) > 0) {
@@ -330,58 +871,116 @@ Vec3f Trace(const Ray&     ray,
 
     if (material.illum > 2) {
         double bias = 0.0001;
-        if (outside) {
+        if (path.outside) {
             Vec3f refldir = Reflect(ray.dir, newN).normalize();
             Vec3f vR = Reflect(-1 * refldir, newN);
 
             Vec3f shiftedP = info.position + bias * newN;
-            Vec3f reflc = Trace(Ray{shiftedP, refldir}, scene, options, depth + 1);
 
-            auto refldiffuse  = reflc * std::max(0.0, newN.dot(refldir));
-            auto reflspecular = reflc * std::pow(std::max(0.0, vR.dot(vE)), material.Ns);
+            // NB: Reflected light is weighted like light of a source along refldir.
+            auto refldiffuse  = std::max(0.0, newN.dot(refldir));
+            auto reflspecular = std::pow(std::max(0.0, vR.dot(vE)), material.Ns);
 
-            Icomp += (Kd * refldiffuse) + (material.Ks * reflspecular);
+            Vec3f weight = (Kd * refldiffuse) + (material.Ks * reflspecular);
+            PushBranch(branches, options,
+                       PathRay{Ray{shiftedP, refldir}, path.weight * weight, path.depth + 1, true});
         }
         // NB: Refraction
-        double Tr  = outside ? material.Tr : 1.0;
-        double ior = outside ? material.Ni : 1 / material.Ni;
+        double Tr  = path.outside ? material.Tr : 1.0;
+        double ior = path.outside ? material.Ni : 1 / material.Ni;
         Vec3f refrdir  = Refract(ray.dir, newN, ior).normalize();
-        Vec3f refrorig = outside ? info.position - (bias * newN) : info.position + (bias * newN);
-        auto refrc =
-            Trace(Ray{refrorig, refrdir}, scene, options, depth + 1, outside ? false : true);
+        Vec3f refrorig = path.outside ? info.position - (bias * newN) : info.position + (bias * newN);
 
-        Icomp += refrc * Tr;
+        PushBranch(branches, options,
+                   PathRay{Ray{refrorig, refrdir}, path.weight * Tr, path.depth + 1, !path.outside});
     }
 
     for (auto&& light : scene.GetLights()) {
         Vec3f new_p = info.position + ((ray.orig - info.position).normalize() * 0.00001);
-        Vec3f newp2light = (light.position - new_p).normalize();
+        Vec3f p2light = light.position - new_p;
+        Vec3f newp2light = p2light.normalize();
 
-        bool no_intersect = false;
-        for (const auto& obj : scene.GetObjects()) {
-            auto has_hit = obj->intersect(Ray{new_p, newp2light});
-            if (!has_hit) {
-                continue;
-            }
+        Vec3f vL = (light.position - info.position).normalize();
+        Vec3f vR = Reflect(-1 * vL, newN);
 
-            const auto& hi = has_hit.value();
-            double len = (hi.position - new_p).length();
-            if (len < (light.position - new_p).length()) {
-                no_intersect = true;
-                break;
-            }
+        lights->push_back(LightSample{Ray{new_p, newp2light}, p2light.length(),
+                                      light.intensity * std::max(0.0, newN.dot(vL)),
+                                      light.intensity * std::pow(std::max(0.0, vR.dot(vE)), material.Ns)});
+    }
+    return SurfaceShading{Ka + material.Ke, Kd, material.Ks};
+}
+
+Vec3f SurfaceShading::Radiance(const Vec3f& diffuse, const Vec3f& specular) const {
+    Vec3f radiance{0.0, 0.0, 0.0};
+    radiance += emitted + Kd * diffuse + (Ks * specular);
+    return radiance;
+}
+
+// NB: Radiance leaving the hit without the reflected and refracted light,
+// the branches carrying those are pushed to the stack instead.
+static Vec3f ShadeLocal(const PathRay&        entry,
+                        const Intersection&   isect,
+                        const Scene&          scene,
+                        const Options&        options,
+                        std::vector<PathRay>* stack) {
+    static thread_local std::vector<LightSample> lights;
+    lights.clear();
+    const auto shading = ShadeSurface(entry, isect, scene, options, &lights, stack);
+
+    Vec3f diffuse{0.0, 0.0, 0.0};
+    Vec3f specular{0.0, 0.0, 0.0};
+    for (const auto& light : lights) {
+        if (scene.Occluded(light.ray, light.distance)) {
+            continue;
         }
+        diffuse  += light.diffuse;
+        specular += light.specular;
+    }
+    return shading.Radiance(diffuse, specular);
+}
+
+// NB: Traces the pending branches until the stack is empty. The stack is per
+// thread and reused across calls, it holds at most one branch per level.
+static Vec3f TraceStack(std::vector<PathRay>* stack, const Scene& scene,
+                        const Options& options, Vec3f radiance) {
+    while (!stack->empty()) {
+        const PathRay entry = stack->back();
+        stack->pop_back();
 
-        if (no_intersect) {
+        auto isect = scene.Intersect(entry.ray);
+        if (!isect) {
             continue;
         }
+        radiance += entry.weight * ShadeLocal(entry, isect.value(), scene, options, stack);
+    }
+    return radiance;
+}
 
-        Vec3f vL = (light.position - info.position).normalize();
-        Vec3f vR = Reflect(-1 * vL, newN);
+static thread_local std::vector<PathRay> path_stack;
 
-        diffuse  += light.intensity * std::max(0.0, newN.dot(vL));
-        specular += light.intensity * std::pow(std::max(0.0, vR.dot(vE)), material.Ns);
+Vec3f Trace(const Ray&     ray,
+            const Scene&   scene,
+            const Options& options,
+            int            depth,
+            bool           outside) {
+    Vec3f background{0.0, 0.0, 0.0};
+    if (depth == options.render_options.depth) {
+        return background;
     }
-    Ibase += Ka + material.Ke + Kd * diffuse + (material.Ks * specular);
-    return Ibase + Icomp;
+
+    path_stack.clear();
+    path_stack.push_back(PathRay{ray, Vec3f{1.0, 1.0, 1.0}, depth, outside});
+    return TraceStack(&path_stack, scene, options, background);
+}
+
+Vec3f Shade(const Ray&          ray,
+            const Intersection& isect,
+            const Scene&        scene,
+            const Options&      options,
+            int                 depth,
+            bool                outside) {
+    path_stack.clear();
+    Vec3f radiance = ShadeLocal(PathRay{ray, Vec3f{1.0, 1.0, 1.0}, depth, outside},
+                                isect, scene, options, &path_stack);
+    return TraceStack(&path_stack, scene, options, radiance);
 }
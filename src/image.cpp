@@ -1,30 +1,55 @@
 #include <raytracer/image.hpp>
 
+#include <new>
+#include <vector>
 #include <stdexcept>
 
 #include <png.h>
 #include <jpeglib.h>
 
 struct Image::Impl {
-    ~Impl();
-
-    int width, height;
-    png_bytep* bytes;
+    int      width    = 0;
+    int      height   = 0;
+    int      channels = 4;
+    size_t   stride   = 0;
+    uint8_t* data     = nullptr;
+    // NB: Empty when the pixels belong to the caller.
+    std::unique_ptr<uint8_t[], void (*)(uint8_t*)> owned{nullptr, [](uint8_t*) {}};
 };
 
-Image::Impl::~Impl() {
-    for (int i = 0; i < height; ++i) {
-        free(bytes[i]);
-    }
-    free(bytes);
+static void FreeAligned(uint8_t* data) {
+    ::operator delete[](data, std::align_val_t(Image::kAlignment));
 }
 
 Image::Image()
     : _impl(new Impl{}) {
 };
 
-Image::Image(int width, int height) : Image() {
-    PrepareImage(width, height);
+Image::Image(int width, int height, int channels) : Image() {
+    PrepareImage(width, height, channels);
+    for (int y = 0; y < height; ++y) {
+        uint8_t* row = Row(y);
+        for (int x = 0; x < width * channels; ++x) {
+            row[x] = x % channels == 3 ? 255 : 0;
+        }
+    }
+}
+
+Image::Image(uint8_t* data, int width, int height, int channels, size_t stride) : Image() {
+    if (channels != 3 && channels != 4) {
+        throw std::logic_error("Only RGB and RGBA images are supported");
+    }
+    if (stride == 0) {
+        stride = static_cast<size_t>(width) * channels;
+    }
+    if (stride < static_cast<size_t>(width) * channels) {
+        throw std::logic_error("Image stride is smaller than a row");
+    }
+    _impl->width    = width;
+    _impl->height   = height;
+    _impl->channels = channels;
+    _impl->stride   = stride;
+    _impl->data     = data;
 }
 
 Image::Image(const std::string& filename) : Image() {
@@ -51,29 +76,14 @@ void Image::ReadJpg(const std::string& filename) {
     jpeg_stdio_src(&cinfo, infile);
 
     (void)jpeg_read_header(&cinfo, true);
+    // NB: Grayscale is expanded by the decoder.
+    cinfo.out_color_space = JCS_RGB;
     (void)jpeg_start_decompress(&cinfo);
 
-    int row_stride = cinfo.output_width * cinfo.output_components;
-    JSAMPARRAY buffer = (*cinfo.mem->alloc_sarray)(reinterpret_cast<j_common_ptr>(&cinfo),
-                                                   JPOOL_IMAGE, row_stride, 1);
-
-    PrepareImage(cinfo.output_width, cinfo.output_height);
-    size_t y = 0;
-
+    PrepareImage(cinfo.output_width, cinfo.output_height, 3);
     while (cinfo.output_scanline < cinfo.output_height) {
-        (void)jpeg_read_scanlines(&cinfo, buffer, 1);
-        for (int x = 0; x < Width(); ++x) {
-            RGB pixel;
-            if (cinfo.output_components == 3) {
-                pixel.r = buffer[0][x * 3];
-                pixel.g = buffer[0][x * 3 + 1];
-                pixel.b = buffer[0][x * 3 + 2];
-            } else {
-                pixel.r = pixel.g = pixel.b = buffer[0][x];
-            }
-            SetPixel(pixel, y, x);
-        }
-        ++y;
+        JSAMPROW row = Row(cinfo.output_scanline);
+        (void)jpeg_read_scanlines(&cinfo, &row, 1);
     }
 
     (void)jpeg_finish_decompress(&cinfo);
@@ -81,17 +91,19 @@ void Image::ReadJpg(const std::string& filename) {
     fclose(infile);
 }
 
-void Image::PrepareImage(int width, int height) {
-    _impl->height = height;
-    _impl->width  = width;
-    _impl->bytes = static_cast<png_bytep*>(malloc(sizeof(png_bytep) * _impl->height));
-    for (int y = 0; y < _impl->height; y++) {
-        _impl->bytes[y] = static_cast<png_byte*>(malloc(_impl->width * sizeof(png_byte) * 4));
-        for (int x = 0; x < _impl->width; ++x) {
-            _impl->bytes[y][x * 4] = _impl->bytes[y][x * 4 + 1] = _impl->bytes[y][x * 4 + 2] = 0;
-            _impl->bytes[y][x * 4 + 3] = 255;
-        }
+void Image::PrepareImage(int width, int height, int channels) {
+    if (channels != 3 && channels != 4) {
+        throw std::logic_error("Only RGB and RGBA images are supported");
     }
+    const size_t row = static_cast<size_t>(width) * channels;
+    _impl->width    = width;
+    _impl->height   = height;
+    _impl->channels = channels;
+    _impl->stride   = (row + kAlignment - 1) / kAlignment * kAlignment;
+    _impl->owned    = {static_cast<uint8_t*>(::operator new[](_impl->stride * height,
+                                                               std::align_val_t(kAlignment))),
+                       FreeAligned};
+    _impl->data     = _impl->owned.get();
 }
 
 void Image::ReadPng(const std::string& filename) {
@@ -117,12 +129,12 @@ void Image::ReadPng(const std::string& filename) {
 
     png_read_info(png, info);
 
-    _impl->width = png_get_image_width(png, info);
-    _impl->height = png_get_image_height(png, info);
+    const int width  = png_get_image_width(png, info);
+    const int height = png_get_image_height(png, info);
     png_byte color_type = png_get_color_type(png, info);
     png_byte bit_depth = png_get_bit_depth(png, info);
 
-    // Read any color_type into 8bit depth, RGBA format.
+    // Read any color_type into 8bit depth, RGB or RGBA format.
     // See http://www.libpng.org/pub/png/libpng-manual.txt
 
     if (bit_depth == 16) {
@@ -138,14 +150,11 @@ void Image::ReadPng(const std::string& filename) {
         png_set_expand_gray_1_2_4_to_8(png);
     }
 
+    // NB: Only images with transparency keep an alpha channel.
+    bool alpha = color_type & PNG_COLOR_MASK_ALPHA;
     if (png_get_valid(png, info, PNG_INFO_tRNS)) {
         png_set_tRNS_to_alpha(png);
-    }
-
-    // These color_type don't have an alpha channel then fill it with 0xff.
-    if (color_type == PNG_COLOR_TYPE_RGB || color_type == PNG_COLOR_TYPE_GRAY ||
-            color_type == PNG_COLOR_TYPE_PALETTE) {
-        png_set_filler(png, 0xFF, PNG_FILLER_AFTER);
+        alpha = true;
     }
 
     if (color_type == PNG_COLOR_TYPE_GRAY || color_type == PNG_COLOR_TYPE_GRAY_ALPHA) {
@@ -154,63 +163,32 @@ void Image::ReadPng(const std::string& filename) {
 
     png_read_update_info(png, info);
 
-    _impl->bytes = static_cast<png_bytep*>(malloc(sizeof(png_bytep) * _impl->height));
-    for (int y = 0; y < _impl->height; y++) {
-        _impl->bytes[y] = static_cast<png_byte*>(malloc(png_get_rowbytes(png, info)));
+    PrepareImage(width, height, alpha ? 4 : 3);
+    std::vector<png_bytep> rows(height);
+    for (int y = 0; y < height; y++) {
+        rows[y] = Row(y);
     }
 
-    png_read_image(png, _impl->bytes);
+    png_read_image(png, rows.data());
     png_destroy_read_struct(&png, &info, nullptr);
     fclose(fp);
 }
 
 void Image::Write(const std::string& filename) {
-    FILE* fp = fopen(filename.c_str(), "wb");
-    if (!fp) {
-        throw std::runtime_error("Can't open file " + filename);
-    }
-
-    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
-    if (!png) {
-        throw std::runtime_error("Can't create png write struct");
+    PngWriter writer(filename, _impl->width, _impl->height, _impl->channels);
+    for (int y = 0; y < _impl->height; ++y) {
+        writer.WriteRow(Row(y));
     }
-
-    png_infop info = png_create_info_struct(png);
-    if (!info) {
-        throw std::runtime_error("Can't create png info struct");
-    }
-
-    if (setjmp(png_jmpbuf(png))) {
-        abort();
-    }
-
-    png_init_io(png, fp);
-
-    // Output is 8bit depth, RGBA format.
-    png_set_IHDR(png, info, _impl->width, _impl->height, 8, PNG_COLOR_TYPE_RGBA, PNG_INTERLACE_NONE,
-            PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
-    png_write_info(png, info);
-
-    // To remove the alpha channel for PNG_COLOR_TYPE_RGB format,
-    // Use png_set_filler().
-    // png_set_filler(png, 0, PNG_FILLER_AFTER);
-
-    png_write_image(png, _impl->bytes);
-    png_write_end(png, nullptr);
-
-    fclose(fp);
-    png_destroy_write_struct(&png, &info);
+    writer.Finish();
 }
 
 RGB Image::GetPixel(int y, int x) const {
-    auto row = _impl->bytes[y];
-    auto px = &row[x * 4];
+    auto px = Row(y) + x * _impl->channels;
     return RGB{px[0], px[1], px[2]};
 }
 
 void Image::SetPixel(const RGB& pixel, int y, int x) {
-    auto row = _impl->bytes[y];
-    auto px = &row[x * 4];
+    auto px = Row(y) + x * _impl->channels;
     px[0] = pixel.r;
     px[1] = pixel.g;
     px[2] = pixel.b;
@@ -223,3 +201,101 @@ int Image::Height() const {
 int Image::Width() const {
     return _impl->width;
 }
+
+int Image::Channels() const {
+    return _impl->channels;
+}
+
+size_t Image::Stride() const {
+    return _impl->stride;
+}
+
+uint8_t* Image::Row(int y) {
+    return _impl->data + y * _impl->stride;
+}
+
+const uint8_t* Image::Row(int y) const {
+    return _impl->data + y * _impl->stride;
+}
+
+/* ############################################# PngWriter Implementation ##################################### */
+
+struct PngWriter::Impl {
+    FILE*       fp   = nullptr;
+    png_structp png  = nullptr;
+    png_infop   info = nullptr;
+    int         height;
+    int         rows = 0;
+
+    // NB: Releases whatever a failed constructor or a missing Finish left.
+    ~Impl() {
+        if (png) {
+            png_destroy_write_struct(&png, &info);
+        }
+        if (fp) {
+            fclose(fp);
+        }
+    }
+};
+
+PngWriter::PngWriter(const std::string& filename, int width, int height, int channels)
+    : _impl(new Impl{}) {
+    if (channels != 3 && channels != 4) {
+        throw std::logic_error("Only RGB and RGBA images are supported");
+    }
+    _impl->height = height;
+
+    _impl->fp = fopen(filename.c_str(), "wb");
+    if (!_impl->fp) {
+        throw std::runtime_error("Can't open file " + filename);
+    }
+
+    _impl->png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    if (!_impl->png) {
+        throw std::runtime_error("Can't create png write struct");
+    }
+
+    _impl->info = png_create_info_struct(_impl->png);
+    if (!_impl->info) {
+        throw std::runtime_error("Can't create png info struct");
+    }
+
+    if (setjmp(png_jmpbuf(_impl->png))) {
+        abort();
+    }
+
+    png_init_io(_impl->png, _impl->fp);
+
+    // Output is 8bit depth, RGB or RGBA format.
+    png_set_IHDR(_impl->png, _impl->info, width, height, 8,
+            channels == 4 ? PNG_COLOR_TYPE_RGBA : PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
+            PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(_impl->png, _impl->info);
+}
+
+PngWriter::~PngWriter() = default;
+
+void PngWriter::WriteRow(const uint8_t* row) {
+    if (_impl->rows == _impl->height) {
+        throw std::logic_error("All rows are written already");
+    }
+    if (setjmp(png_jmpbuf(_impl->png))) {
+        abort();
+    }
+    png_write_row(_impl->png, const_cast<uint8_t*>(row));
+    ++_impl->rows;
+}
+
+void PngWriter::Finish() {
+    if (_impl->rows != _impl->height) {
+        throw std::logic_error("Not all rows are written");
+    }
+    if (setjmp(png_jmpbuf(_impl->png))) {
+        abort();
+    }
+    png_write_end(_impl->png, nullptr);
+    png_destroy_write_struct(&_impl->png, &_impl->info);
+    _impl->png = nullptr;
+    fclose(_impl->fp);
+    _impl->fp = nullptr;
+}
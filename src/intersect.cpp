@@ -0,0 +1,41 @@
+#include <raytracer/geometry.hpp>
+
+#ifdef RAYTRACER_HAVE_AVX2
+int IntersectPacketAVX2(const TrianglePacket& packet, const Ray& ray,
+                        double* tmax, double* u, double* v);
+#endif
+
+int IntersectPacketScalar(const TrianglePacket& packet, const Ray& ray,
+                          double* tmax, double* u, double* v) {
+    int hit = -1;
+    for (int lane = 0; lane < TrianglePacket::kWidth; ++lane) {
+        TriangleRecord tri{{packet.v0x[lane], packet.v0y[lane], packet.v0z[lane]},
+                           {packet.e1x[lane], packet.e1y[lane], packet.e1z[lane]},
+                           {packet.e2x[lane], packet.e2y[lane], packet.e2z[lane]}};
+        double t, lu, lv;
+        if (IntersectTriangle(tri, ray, &t, &lu, &lv) && t < *tmax) {
+            *tmax = t;
+            *u    = lu;
+            *v    = lv;
+            hit   = lane;
+        }
+    }
+    return hit;
+}
+
+using PacketKernel = int (*)(const TrianglePacket&, const Ray&, double*, double*, double*);
+
+static PacketKernel SelectPacketKernel() {
+#ifdef RAYTRACER_HAVE_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        return IntersectPacketAVX2;
+    }
+#endif
+    return IntersectPacketScalar;
+}
+
+int IntersectPacket(const TrianglePacket& packet, const Ray& ray,
+                    double* tmax, double* u, double* v) {
+    static const PacketKernel kernel = SelectPacketKernel();
+    return kernel(packet, ray, tmax, u, v);
+}
@@ -0,0 +1,143 @@
+#include <immintrin.h>
+#include <cstring>
+
+#include <raytracer/geometry.hpp>
+#include <raytracer/wide_bvh.hpp>
+
+// NB: Lane-parallel version of IntersectTriangle. Every operation is
+// performed in the same order as the scalar code, so results are
+// bit-identical as long as no FMA contraction happens.
+int IntersectPacketAVX2(const TrianglePacket& packet, const Ray& ray,
+                        double* tmax, double* u, double* v) {
+    constexpr double kEpsilon = 1e-8;
+
+    const __m256d dx = _mm256_set1_pd(ray.dir.x);
+    const __m256d dy = _mm256_set1_pd(ray.dir.y);
+    const __m256d dz = _mm256_set1_pd(ray.dir.z);
+
+    const __m256d e1x = _mm256_load_pd(packet.e1x);
+    const __m256d e1y = _mm256_load_pd(packet.e1y);
+    const __m256d e1z = _mm256_load_pd(packet.e1z);
+    const __m256d e2x = _mm256_load_pd(packet.e2x);
+    const __m256d e2y = _mm256_load_pd(packet.e2y);
+    const __m256d e2z = _mm256_load_pd(packet.e2z);
+
+    auto dot = [](__m256d ax, __m256d ay, __m256d az,
+                  __m256d bx, __m256d by, __m256d bz) {
+        return _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ax, bx),
+                                           _mm256_mul_pd(ay, by)),
+                             _mm256_mul_pd(az, bz));
+    };
+
+    // NB: pvec = dir x e2
+    const __m256d px = _mm256_sub_pd(_mm256_mul_pd(dy, e2z), _mm256_mul_pd(dz, e2y));
+    const __m256d py = _mm256_sub_pd(_mm256_mul_pd(dz, e2x), _mm256_mul_pd(dx, e2z));
+    const __m256d pz = _mm256_sub_pd(_mm256_mul_pd(dx, e2y), _mm256_mul_pd(dy, e2x));
+
+    const __m256d det = dot(e1x, e1y, e1z, px, py, pz);
+
+    // NB: Unordered predicates reproduce the scalar early-outs, which
+    // reject a lane only when the comparison is true.
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    __m256d mask = _mm256_cmp_pd(_mm256_andnot_pd(sign, det),
+                                 _mm256_set1_pd(kEpsilon), _CMP_NLT_UQ);
+    if (_mm256_movemask_pd(mask) == 0) {
+        return -1;
+    }
+
+    const __m256d inv_det = _mm256_div_pd(_mm256_set1_pd(1.0), det);
+
+    const __m256d tx = _mm256_sub_pd(_mm256_set1_pd(ray.orig.x), _mm256_load_pd(packet.v0x));
+    const __m256d ty = _mm256_sub_pd(_mm256_set1_pd(ray.orig.y), _mm256_load_pd(packet.v0y));
+    const __m256d tz = _mm256_sub_pd(_mm256_set1_pd(ray.orig.z), _mm256_load_pd(packet.v0z));
+
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d one  = _mm256_set1_pd(1.0);
+
+    const __m256d lu = _mm256_mul_pd(dot(tx, ty, tz, px, py, pz), inv_det);
+    mask = _mm256_and_pd(mask, _mm256_cmp_pd(lu, zero, _CMP_NLT_UQ));
+    mask = _mm256_and_pd(mask, _mm256_cmp_pd(lu, one,  _CMP_NGT_UQ));
+
+    // NB: qvec = tvec x e1
+    const __m256d qx = _mm256_sub_pd(_mm256_mul_pd(ty, e1z), _mm256_mul_pd(tz, e1y));
+    const __m256d qy = _mm256_sub_pd(_mm256_mul_pd(tz, e1x), _mm256_mul_pd(tx, e1z));
+    const __m256d qz = _mm256_sub_pd(_mm256_mul_pd(tx, e1y), _mm256_mul_pd(ty, e1x));
+
+    const __m256d lv = _mm256_mul_pd(dot(dx, dy, dz, qx, qy, qz), inv_det);
+    mask = _mm256_and_pd(mask, _mm256_cmp_pd(lv, zero, _CMP_NLT_UQ));
+    mask = _mm256_and_pd(mask, _mm256_cmp_pd(_mm256_add_pd(lu, lv), one, _CMP_NGT_UQ));
+
+    const __m256d t = _mm256_mul_pd(dot(e2x, e2y, e2z, qx, qy, qz), inv_det);
+    mask = _mm256_and_pd(mask, _mm256_cmp_pd(t, zero, _CMP_GE_OQ));
+    mask = _mm256_and_pd(mask, _mm256_cmp_pd(t, _mm256_set1_pd(*tmax), _CMP_LT_OQ));
+
+    int bits = _mm256_movemask_pd(mask);
+    if (bits == 0) {
+        return -1;
+    }
+
+    alignas(32) double ts[TrianglePacket::kWidth];
+    alignas(32) double us[TrianglePacket::kWidth];
+    alignas(32) double vs[TrianglePacket::kWidth];
+    _mm256_store_pd(ts, t);
+    _mm256_store_pd(us, lu);
+    _mm256_store_pd(vs, lv);
+
+    // NB: Same selection as the scalar loop, the lowest lane wins ties.
+    int hit = -1;
+    for (int lane = 0; lane < TrianglePacket::kWidth; ++lane) {
+        if ((bits >> lane & 1) && ts[lane] < *tmax) {
+            *tmax = ts[lane];
+            *u    = us[lane];
+            *v    = vs[lane];
+            hit   = lane;
+        }
+    }
+    return hit;
+}
+
+// NB: Four child boxes per vector, decoded and tested in the same order
+// as IntersectChildrenScalar.
+template <int N>
+uint32_t IntersectChildrenAVX2(const WideNode<N>& node, const Vec3f& orig,
+                               const Vec3f& inv_dir, double tmax, double* tnear) {
+    const double o[3]   = {orig.x, orig.y, orig.z};
+    const double inv[3] = {inv_dir.x, inv_dir.y, inv_dir.z};
+
+    auto decode = [](const uint8_t* q) {
+        int32_t packed;
+        std::memcpy(&packed, q, sizeof(packed));
+        return _mm256_cvtepi32_pd(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed)));
+    };
+
+    uint32_t mask = 0;
+    for (int base = 0; base < N; base += 4) {
+        __m256d t0 = _mm256_setzero_pd();
+        __m256d t1 = _mm256_set1_pd(tmax);
+        for (int axis = 0; axis < 3; ++axis) {
+            const __m256d origin = _mm256_set1_pd(node.origin[axis]);
+            const __m256d scale  = _mm256_set1_pd(node.scale[axis]);
+            const __m256d oa     = _mm256_set1_pd(o[axis]);
+            const __m256d ia     = _mm256_set1_pd(inv[axis]);
+
+            const __m256d lo = _mm256_add_pd(origin, _mm256_mul_pd(decode(&node.qlo[axis][base]), scale));
+            const __m256d hi = _mm256_add_pd(origin, _mm256_mul_pd(decode(&node.qhi[axis][base]), scale));
+            const __m256d a  = _mm256_mul_pd(_mm256_sub_pd(lo, oa), ia);
+            const __m256d b  = _mm256_mul_pd(_mm256_sub_pd(hi, oa), ia);
+
+            const __m256d swap = _mm256_cmp_pd(a, b, _CMP_GT_OQ);
+            const __m256d tlo  = _mm256_blendv_pd(a, b, swap);
+            const __m256d thi  = _mm256_blendv_pd(b, a, swap);
+            t0 = _mm256_blendv_pd(t0, tlo, _mm256_cmp_pd(tlo, t0, _CMP_GT_OQ));
+            t1 = _mm256_blendv_pd(t1, thi, _mm256_cmp_pd(thi, t1, _CMP_LT_OQ));
+        }
+        _mm256_storeu_pd(tnear + base, t0);
+        mask |= static_cast<uint32_t>(_mm256_movemask_pd(_mm256_cmp_pd(t0, t1, _CMP_LE_OQ))) << base;
+    }
+    return mask & ((1u << node.num_children) - 1);
+}
+
+template uint32_t IntersectChildrenAVX2<4>(const WideNode<4>&, const Vec3f&, const Vec3f&,
+                                           double, double*);
+template uint32_t IntersectChildrenAVX2<8>(const WideNode<8>&, const Vec3f&, const Vec3f&,
+                                           double, double*);
@@ -0,0 +1,138 @@
+#include <cmath>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+
+#include <raytracer/postprocess.hpp>
+
+static_assert(sizeof(Vec3f) == 3 * sizeof(double), "Pixels are read as interleaved doubles");
+
+#ifdef RAYTRACER_HAVE_AVX2
+void ToneMapAVX2(const Vec3f* pixels, size_t count, double C, uint8_t* rgb);
+#endif
+
+// NB: Operations are in the order of the Vec3f expression
+// pixel * (1 + pixel / (C * C)) / (1 + pixel).
+static double ToneMapChannel(double v, double C2) {
+    return v * (v / C2 + 1) / (v + 1);
+}
+
+static int GammaByte(double t) {
+    return static_cast<int>(std::pow(t, 1 / 2.2) * 255);
+}
+
+void ToneMapScalar(const Vec3f* pixels, size_t count, double C, uint8_t* rgb) {
+    const double  C2 = C * C;
+    const double* in = &pixels[0].x;
+    for (size_t k = 0; k < count * 3; ++k) {
+        rgb[k] = static_cast<uint8_t>(std::min(GammaByte(ToneMapChannel(in[k], C2)), 255));
+    }
+}
+
+static uint64_t Bits(double t) {
+    uint64_t bits;
+    std::memcpy(&bits, &t, sizeof(bits));
+    return bits;
+}
+
+static double FromBits(uint64_t bits) {
+    double t;
+    std::memcpy(&t, &bits, sizeof(t));
+    return t;
+}
+
+static constexpr int kCellShift = 52 - GammaTable::kMantissaBits;
+
+uint64_t GammaTable::FirstCell() {
+    return Bits(std::ldexp(1.0, kMinExponent)) >> kCellShift;
+}
+
+int GammaTable::Cell(double t) {
+    return static_cast<int>((Bits(t) >> kCellShift) - FirstCell());
+}
+
+// NB: The reference is monotonic in t, so every threshold is found by
+// bisection over the bit patterns of non-negative doubles, which are
+// ordered like the values.
+static void BuildThresholds(GammaTable* table) {
+    table->thresholds[0] = -std::numeric_limits<double>::infinity();
+    for (int b = 1; b < 256; ++b) {
+        uint64_t lo = 0;
+        uint64_t hi = Bits(1.0);
+        while (lo < hi) {
+            const uint64_t mid = lo + (hi - lo) / 2;
+            if (GammaByte(FromBits(mid)) >= b) {
+                hi = mid;
+            } else {
+                lo = mid + 1;
+            }
+        }
+        table->thresholds[b] = FromBits(lo);
+    }
+}
+
+static void BuildCells(GammaTable* table) {
+    const uint64_t first = GammaTable::FirstCell();
+    int b = 0;
+    for (int cell = 0; cell < GammaTable::kNumCells; ++cell) {
+        const double begin = FromBits((first + cell) << kCellShift);
+        const double end   = FromBits((first + cell + 1) << kCellShift);
+        while (b < 255 && table->thresholds[b + 1] <= begin) {
+            ++b;
+        }
+        table->cell_bytes[cell]      = b;
+        table->cell_thresholds[cell] = std::numeric_limits<double>::infinity();
+        if (b < 255 && table->thresholds[b + 1] < end) {
+            if (b < 254 && table->thresholds[b + 2] < end) {
+                throw std::logic_error("Gamma table cells are too wide");
+            }
+            table->cell_thresholds[cell] = table->thresholds[b + 1];
+        }
+    }
+}
+
+const GammaTable& GetGammaTable() {
+    static const auto table = []() {
+        auto table = std::make_unique<GammaTable>();
+        BuildThresholds(table.get());
+        BuildCells(table.get());
+        return table;
+    }();
+    return *table;
+}
+
+static uint8_t QuantizeChannel(const GammaTable& table, double t) {
+    static const double kMin = std::ldexp(1.0, GammaTable::kMinExponent);
+    // NB: NaN goes to the bottom.
+    t = t >= kMin ? t : kMin;
+    t = t <= 1.0 ? t : 1.0;
+    const int cell = GammaTable::Cell(t);
+    return static_cast<uint8_t>(table.cell_bytes[cell] + (t >= table.cell_thresholds[cell]));
+}
+
+static void ToneMapTable(const Vec3f* pixels, size_t count, double C, uint8_t* rgb) {
+    const auto&   table = GetGammaTable();
+    const double  C2 = C * C;
+    const double* in = &pixels[0].x;
+    for (size_t k = 0; k < count * 3; ++k) {
+        rgb[k] = QuantizeChannel(table, ToneMapChannel(in[k], C2));
+    }
+}
+
+using ToneMapKernel = void (*)(const Vec3f*, size_t, double, uint8_t*);
+
+static ToneMapKernel SelectToneMapKernel() {
+#ifdef RAYTRACER_HAVE_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        return ToneMapAVX2;
+    }
+#endif
+    return ToneMapTable;
+}
+
+void ToneMap(const Vec3f* pixels, size_t count, double C, uint8_t* rgb) {
+    static const ToneMapKernel kernel = SelectToneMapKernel();
+    kernel(pixels, count, C, rgb);
+}
@@ -0,0 +1,51 @@
+#include <immintrin.h>
+#include <cmath>
+
+#include <raytracer/postprocess.hpp>
+
+// NB: Same operations in the same order as the scalar kernels, four
+// channels at a time, with both cell arrays read by gathers.
+void ToneMapAVX2(const Vec3f* pixels, size_t count, double C, uint8_t* rgb) {
+    const auto&   table = GetGammaTable();
+    const double* in = &pixels[0].x;
+    const size_t  n  = count * 3;
+    const double  C2 = C * C;
+    const double  lo = std::ldexp(1.0, GammaTable::kMinExponent);
+
+    const __m256d c2    = _mm256_set1_pd(C2);
+    const __m256d one   = _mm256_set1_pd(1.0);
+    const __m256d min   = _mm256_set1_pd(lo);
+    const __m256i first = _mm256_set1_epi64x(static_cast<int64_t>(GammaTable::FirstCell()));
+    const __m256i bit   = _mm256_set1_epi64x(1);
+
+    size_t k = 0;
+    for (; k + 4 <= n; k += 4) {
+        const __m256d v = _mm256_loadu_pd(in + k);
+        __m256d t = _mm256_div_pd(_mm256_mul_pd(v, _mm256_add_pd(_mm256_div_pd(v, c2), one)),
+                                  _mm256_add_pd(v, one));
+        // NB: max returns the second operand for NaN.
+        t = _mm256_min_pd(_mm256_max_pd(t, min), one);
+
+        const __m256i cell = _mm256_sub_epi64(
+            _mm256_srli_epi64(_mm256_castpd_si256(t), 52 - GammaTable::kMantissaBits), first);
+        const __m256d thr  = _mm256_i64gather_pd(table.cell_thresholds, cell, 8);
+        const __m256i byte = _mm256_i64gather_epi64(
+            reinterpret_cast<const long long*>(table.cell_bytes), cell, 8);
+        const __m256i ge   = _mm256_castpd_si256(_mm256_cmp_pd(t, thr, _CMP_GE_OQ));
+        const __m256i b    = _mm256_add_epi64(byte, _mm256_and_si256(ge, bit));
+
+        alignas(32) int64_t lanes[4];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), b);
+        for (int lane = 0; lane < 4; ++lane) {
+            rgb[k + lane] = static_cast<uint8_t>(lanes[lane]);
+        }
+    }
+
+    for (; k < n; ++k) {
+        double t = in[k] * (in[k] / C2 + 1) / (in[k] + 1);
+        t = t >= lo ? t : lo;
+        t = t <= 1.0 ? t : 1.0;
+        const int cell = GammaTable::Cell(t);
+        rgb[k] = static_cast<uint8_t>(table.cell_bytes[cell] + (t >= table.cell_thresholds[cell]));
+    }
+}
@@ -2,6 +2,17 @@
 #include <string>
 #include <optional>
 #include <memory>
+#include <algorithm>
+#include <stdexcept>
+#include <chrono>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <limits>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
 
 #include <math.h>
 
@@ -10,107 +21,938 @@
 #include <raytracer/parser.hpp>
 #include <raytracer/datatypes.hpp>
 #include <raytracer/geometry.hpp>
+#include <raytracer/scheduler.hpp>
+#include <raytracer/checkpoint.hpp>
+#include <raytracer/postprocess.hpp>
 
-static Vec3f tone_mapping(Vec3f pixel, double C) {
-    return pixel * ((1 + (pixel / (C * C)))) / (1 + pixel);
+// NB: Rows handed to a thread at once by postprocessing.
+static constexpr int kPostprocessRows = 16;
+
+// NB: Calls f(y) for every row in [0, height), bands of rows run in parallel.
+template <typename F>
+static void ForRows(int height, int num_threads, F&& f) {
+    const int num_bands = (height + kPostprocessRows - 1) / kPostprocessRows;
+    ParallelFor(num_bands, num_threads, [&](int band) {
+        const int end = std::min(height, (band + 1) * kPostprocessRows);
+        for (int y = band * kPostprocessRows; y < end; ++y) {
+            f(y);
+        }
+    });
+}
+
+// NB: Largest channel of the frame, a parallel reduction over bands of
+// rows. row(y) returns the radiance of row y.
+template <typename RowFn>
+static double FrameMax(int width, int height, int num_threads, RowFn&& row) {
+    std::vector<double> row_max(height, std::numeric_limits<double>::min());
+    ForRows(height, num_threads, [&](int y) {
+        const Vec3f* pixels = row(y);
+        double       C      = row_max[y];
+        for (int x = 0; x < width; ++x) {
+            C = std::max({C, pixels[x].x, pixels[x].y, pixels[x].z});
+        }
+        row_max[y] = C;
+    });
+    double C = std::numeric_limits<double>::min();
+    for (auto max : row_max) {
+        C = std::max(C, max);
+    }
+    return C;
+}
+
+// NB: Tone maps by C, applies gamma and converts to 8 bits in a single
+// pass, straight into the rows of image.
+template <typename RowFn>
+static void ToneMapRows(int num_threads, double C, RowFn&& row, Image* image) {
+    const int width  = image->Width();
+    const int height = image->Height();
+
+    ForRows(height, num_threads, [&](int y) {
+        if (image->Channels() == 3) {
+            ToneMap(row(y), width, C, image->Row(y));
+            return;
+        }
+        // NB: Alpha is left as is.
+        static thread_local std::vector<uint8_t> rgb;
+        rgb.resize(static_cast<size_t>(width) * 3);
+        ToneMap(row(y), width, C, rgb.data());
+        uint8_t* out = image->Row(y);
+        for (int x = 0; x < width; ++x) {
+            out[x * 4]     = rgb[x * 3];
+            out[x * 4 + 1] = rgb[x * 3 + 1];
+            out[x * 4 + 2] = rgb[x * 3 + 2];
+        }
+    });
 }
 
-static Vec3f gamma_correction(Vec3f pixel) {
-    return pixel.exp(1 / 2.2);
+// NB: Tone maps by the largest channel of the frame.
+template <typename RowFn>
+static void ToneMapFrame(int num_threads, RowFn&& row, Image* image) {
+    const double C = FrameMax(image->Width(), image->Height(), num_threads, row);
+    ToneMapRows(num_threads, C, row, image);
 }
 
-static RGB toRGB(Vec3f Vgamma) {
-    RGB pixel{static_cast<int>(Vgamma.x * 255), static_cast<int>(Vgamma.y * 255),
-              static_cast<int>(Vgamma.z * 255)};
-    return pixel;
+static void ToneMapInto(const Matf& mat, int num_threads, Image* image) {
+    ToneMapFrame(num_threads, [&](int y) { return mat.Row(y); }, image);
 }
 
-static void postprocessing(Matf& mat) {
-    double C = std::numeric_limits<double>::min();
-    for (int i = 0; i < mat.GetW(); ++i) {
-        for (int j = 0; j < mat.GetH(); ++j) {
-            auto& vec = mat[i][j];
-            double max = std::max({vec.x, vec.y, vec.z});
-            if (max > C) {
-                C = max;
+static Image ToImage(const Matf& mat, int num_threads) {
+    Image image(static_cast<int>(mat.GetW()), static_cast<int>(mat.GetH()), 3);
+    ToneMapInto(mat, num_threads, &image);
+    return image;
+}
+
+// NB: Uniform number in [0, 1) depending only on the arguments, so
+// samples don't depend on the order tiles are rendered in.
+static double Jitter(uint32_t i, uint32_t j, uint32_t pass, uint32_t dim) {
+    uint32_t h = i * 0x8da6b343u ^ j * 0xd8163841u ^ pass * 0xcb1ab31fu ^ dim * 0x165667b1u;
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return (h >> 8) * (1.0 / (1u << 24));
+}
+
+// NB: Generates primary rays through points of the image plane
+// given in pixels, e.g. (i + 0.5, j + 0.5) for pixel centers.
+struct Camera {
+    Camera(const CameraOptions& camera_options) {
+        width  = camera_options.screen_width;
+        height = camera_options.screen_height;
+
+        from = Vec3f{camera_options.look_from};
+        Vec3f to = Vec3f{camera_options.look_to};
+
+        // FIXME: Ugly stub !!!!
+        Vec3f tmp =
+            (from - to).normalize().cross(Vec3f{0, 1, 0}).IsZero() ? Vec3f{0, 0, -1} : Vec3f{0, 1, 0};
+
+        scale = std::tan(camera_options.fov * 0.5);
+        ratio = width / static_cast<double>(height);
+
+        forward = (from - to).normalize();
+        right = tmp.cross(forward).normalize();
+        up = forward.cross(right).normalize();
+    }
+
+    Ray GetRay(double px, double py) const {
+        // FIXME: Should it be without static_cast ???
+        double ps_x = px / static_cast<double>(width);
+        double ps_y = (py + first_row) / static_cast<double>(height);
+
+        double x = (2 * ps_x - 1) * scale * ratio;
+        double y = (1 - 2 * ps_y) * scale;
+
+        Vec3f view{x, y, -1};
+        Vec3f zero{0, 0, 0};
+
+        Ray ray;
+
+        ray.orig = Vec3f{zero.dot(Vec3f{right.x, up.x, forward.x}) + from.x,
+                         zero.dot(Vec3f{right.y, up.y, forward.y}) + from.y,
+                         zero.dot(Vec3f{right.z, up.z, forward.z}) + from.z};
+
+        auto p = Vec3f{view.dot(Vec3f{right.x, up.x, forward.x}) + from.x,
+                       view.dot(Vec3f{right.y, up.y, forward.y}) + from.y,
+                       view.dot(Vec3f{right.z, up.z, forward.z}) + from.z};
+
+        ray.dir = (p - ray.orig).normalize();
+        return ray;
+    }
+
+    int    width, height;
+    double scale, ratio;
+    Vec3f  from, forward, right, up;
+    // NB: Screen row of py = 0, for rendering bands of the screen.
+    int    first_row = 0;
+};
+
+// NB: Primary rays of every block of the tile are intersected as one
+// packet, secondary rays are still traced one by one.
+static void RenderPackets(const Scene&   scene,
+                          const Camera&  camera,
+                          const Options& options,
+                          const Tile&    tile,
+                          Matf&          mat) {
+    const int size = options.render_options.packet_size;
+
+    for (int bj = tile.y0; bj < tile.y1; bj += size) {
+        for (int bi = tile.x0; bi < tile.x1; bi += size) {
+            const int ei = std::min(bi + size, tile.x1);
+            const int ej = std::min(bj + size, tile.y1);
+
+            RayPacket packet;
+            Ray       rays[RayPacket::kMaxSize];
+            for (int j = bj; j < ej; ++j) {
+                for (int i = bi; i < ei; ++i) {
+                    rays[packet.size] = camera.GetRay(i + 0.5, j + 0.5);
+                    packet.Set(packet.size, rays[packet.size].orig, rays[packet.size].dir);
+                    ++packet.size;
+                }
+            }
+
+            Intersection hits[RayPacket::kMaxSize];
+            RayPacket::Mask mask =
+                options.render_options.depth > 0 ? scene.Intersect(packet, hits) : 0;
+
+            int lane = 0;
+            for (int j = bj; j < ej; ++j) {
+                for (int i = bi; i < ei; ++i, ++lane) {
+                    mat(i, j) = (mask >> lane & 1) ? Shade(rays[lane], hits[lane], scene, options)
+                                                   : Vec3f{0.0, 0.0, 0.0};
+                }
             }
         }
     }
+}
+
+static double Luminance(const Vec3f& v) {
+    return 0.2126 * v.x + 0.7152 * v.y + 0.0722 * v.z;
+}
+
+// NB: Largest relative luminance difference between the pixel
+// and its 4-neighbours.
+static double Contrast(const Matf& mat, int i, int j) {
+    const double l = Luminance(mat(i, j));
+    const int di[] = {-1, 1, 0, 0};
+    const int dj[] = {0, 0, -1, 1};
+
+    double contrast = 0;
+    for (int k = 0; k < 4; ++k) {
+        const int ni = i + di[k];
+        const int nj = j + dj[k];
+        if (ni < 0 || nj < 0 || ni >= mat.GetW() || nj >= mat.GetH()) {
+            continue;
+        }
+        const double n = Luminance(mat(ni, nj));
+        const double sum = l + n;
+        if (sum > 0) {
+            contrast = std::max(contrast, std::abs(l - n) / sum);
+        }
+    }
+    return contrast;
+}
+
+// NB: Adds samples at jittered positions to the pixel center sample
+// in first, writes the mean to mat and returns the number of samples.
+static int SamplePixel(const Scene&   scene,
+                       const Camera&  camera,
+                       const Options& options,
+                       const Matf&    first,
+                       int            i,
+                       int            j,
+                       Matf&          mat) {
+    // NB: Too few samples for a meaningful variance estimate.
+    static constexpr int kMinVarianceSamples = 4;
+
+    const auto& render_options = options.render_options;
+    const bool  refine = Contrast(first, i, j) > render_options.sample_threshold;
 
-    for (int i = 0; i < mat.GetW(); ++i) {
-        for (int j = 0; j < mat.GetH(); ++j) {
-            auto& vec = mat[i][j];
-            mat[i][j] = gamma_correction(tone_mapping(vec, C));
+    Vec3f  sum    = first(i, j);
+    double lum    = Luminance(sum);
+    double lum_sq = lum * lum;
+    int    n      = 1;
+
+    auto error = [&]() {
+        const double mean     = lum / n;
+        const double variance = std::max(0.0, lum_sq / n - mean * mean) / (n - 1);
+        return std::sqrt(variance) / std::max(mean, 1e-3);
+    };
+
+    while (n < render_options.max_samples) {
+        if (n >= render_options.min_samples) {
+            if (!refine || (n >= kMinVarianceSamples && error() <= render_options.sample_threshold)) {
+                break;
+            }
         }
+        const int row = j + camera.first_row;
+        Vec3f sample = Trace(camera.GetRay(i + Jitter(i, row, n, 0), j + Jitter(i, row, n, 1)),
+                             scene, options);
+        sum    += sample;
+        lum    += Luminance(sample);
+        lum_sq += Luminance(sample) * Luminance(sample);
+        ++n;
     }
+
+    mat(i, j) = n == 1 ? sum : sum / n;
+    return n;
+}
+
+// NB: Optional hooks of RenderFrame used by RenderAsync.
+struct FrameHooks {
+    // NB: Checked before every tile, stops the render once set.
+    const std::atomic<bool>* cancelled  = nullptr;
+    // NB: Incremented after every tile of every pass.
+    std::atomic<int>*        tiles_done = nullptr;
+    // NB: Called once the radiance of a tile is final.
+    TileCallback             on_tile;
+    // NB: Tiles for which it returns true are not rendered.
+    std::function<bool(const Tile&)> skip;
+};
+
+// NB: Number of passes over the tiles RenderFrame makes.
+static int NumPasses(const RenderOptions& render_options) {
+    return render_options.max_samples > 1 ? 2 : 1;
+}
+
+// NB: Renders the radiance of the frame into result, or of the band of
+// screen rows starting at first_row if result is shorter than the screen.
+// Adaptive sampling doesn't see the contrast across band edges. Returns
+// false if it was cancelled, the radiance of unfinished tiles is undefined
+// then.
+static bool RenderFrame(const Scene&         scene,
+                        const CameraOptions& camera_options,
+                        const RenderOptions& render_options,
+                        const FrameHooks&    hooks,
+                        RenderStats*         stats,
+                        Matf*                result,
+                        int                  first_row = 0) {
+    int width = static_cast<int>(result->GetW());
+    int height = static_cast<int>(result->GetH());
+
+    Options options{camera_options, render_options};
+    Camera  camera{camera_options};
+    camera.first_row = first_row;
+
+    Matf& mat = *result;
+
+    const int packet_size = render_options.packet_size;
+    if (packet_size * packet_size > RayPacket::kMaxSize) {
+        throw std::logic_error("Packet size must not exceed " +
+                               std::to_string(RayPacket::kMaxSize) + " rays");
+    }
+    if (render_options.min_samples < 1 || render_options.max_samples < render_options.min_samples) {
+        throw std::logic_error("Samples per pixel must satisfy 1 <= min <= max");
+    }
+
+    const bool adaptive = render_options.max_samples > 1;
+
+    TileScheduler scheduler(width, height, render_options.tile_size, render_options.num_threads);
+
+    // NB: Wraps the work on a tile with the hooks.
+    auto run = [&](bool last, const std::function<void(const Tile&, int)>& f) {
+        return scheduler.Run([&](const Tile& tile, int thread) {
+            if (hooks.cancelled && *hooks.cancelled) {
+                scheduler.Cancel();
+                return;
+            }
+            if (hooks.skip && hooks.skip(tile)) {
+                if (hooks.tiles_done) {
+                    ++*hooks.tiles_done;
+                }
+                return;
+            }
+            f(tile, thread);
+            if (last && hooks.on_tile) {
+                hooks.on_tile(tile, mat);
+            }
+            if (hooks.tiles_done) {
+                ++*hooks.tiles_done;
+            }
+        });
+    };
+
+    bool done = run(!adaptive, [&](const Tile& tile, int) {
+        if (packet_size > 0) {
+            RenderPackets(scene, camera, options, tile, mat);
+            return;
+        }
+        for (int j = tile.y0; j < tile.y1; ++j) {
+            for (int i = tile.x0; i < tile.x1; ++i) {
+                Vec3f intensity = Trace(camera.GetRay(i + 0.5, j + 0.5), scene, options);
+                mat(i, j) = intensity;
+            }
+        }
+    });
+
+    if (stats) {
+        stats->threads = scheduler.GetStats();
+        stats->samples = static_cast<int64_t>(width) * height;
+    }
+
+    // NB: The pass over pixel centers above estimates the contrast, the
+    // second one spends extra samples where it or the variance is high.
+    if (done && adaptive) {
+        const Matf first = mat;
+        std::vector<int64_t> samples(scheduler.GetNumThreads(), 0);
+        done = run(true, [&](const Tile& tile, int thread) {
+            for (int j = tile.y0; j < tile.y1; ++j) {
+                for (int i = tile.x0; i < tile.x1; ++i) {
+                    samples[thread] += SamplePixel(scene, camera, options, first, i, j, mat);
+                }
+            }
+        });
+
+        if (stats) {
+            stats->samples = 0;
+            for (size_t t = 0; t < samples.size(); ++t) {
+                stats->samples += samples[t];
+                stats->threads[t].busy_ms += scheduler.GetStats()[t].busy_ms;
+                stats->threads[t].idle_ms += scheduler.GetStats()[t].idle_ms;
+                stats->threads[t].tiles   += scheduler.GetStats()[t].tiles;
+                stats->threads[t].stolen  += scheduler.GetStats()[t].stolen;
+            }
+        }
+    }
+
+    return done;
 }
 
 Image Render(const Scene& scene,
              const CameraOptions& camera_options,
-             const RenderOptions& render_options) {
-    int width = camera_options.screen_width;
-    int height = camera_options.screen_height;
-    double fov = camera_options.fov;
+             const RenderOptions& render_options,
+             RenderStats*         stats) {
+    Matf mat(camera_options.screen_width, camera_options.screen_height);
+    RenderFrame(scene, camera_options, render_options, FrameHooks{}, stats, &mat);
+    return ToImage(mat, render_options.num_threads);
+}
+
+void RenderInto(const Scene&         scene,
+                const CameraOptions& camera_options,
+                const RenderOptions& render_options,
+                Image*               image,
+                RenderStats*         stats) {
+    if (image->Width() != camera_options.screen_width ||
+        image->Height() != camera_options.screen_height) {
+        throw std::logic_error("Image size doesn't match the screen");
+    }
+    Matf mat(camera_options.screen_width, camera_options.screen_height);
+    RenderFrame(scene, camera_options, render_options, FrameHooks{}, stats, &mat);
+    ToneMapInto(mat, render_options.num_threads, image);
+}
+
+// NB: Rows RenderHdr stages as doubles at once without adaptive sampling.
+static constexpr int kHdrBandRows = 64;
+
+// NB: Adds the statistics of a band to the ones of the frame, which are
+// replaced by the first band.
+static void AddStats(const RenderStats& band, bool first, RenderStats* total) {
+    if (first) {
+        *total = band;
+        return;
+    }
+    total->samples += band.samples;
+    for (size_t t = 0; t < band.threads.size(); ++t) {
+        total->threads[t].busy_ms += band.threads[t].busy_ms;
+        total->threads[t].idle_ms += band.threads[t].idle_ms;
+        total->threads[t].tiles   += band.threads[t].tiles;
+        total->threads[t].stolen  += band.threads[t].stolen;
+    }
+}
+
+static size_t HdrStride(const HdrBuffer& buffer) {
+    if (buffer.channels != 3 && buffer.channels != 4) {
+        throw std::logic_error("Only RGB and RGBA buffers are supported");
+    }
+    const size_t row = static_cast<size_t>(buffer.width) * buffer.channels;
+    if (buffer.stride != 0 && buffer.stride < row) {
+        throw std::logic_error("Buffer stride is smaller than a row");
+    }
+    return buffer.stride == 0 ? row : buffer.stride;
+}
+
+void RenderHdr(const Scene&         scene,
+               const CameraOptions& camera_options,
+               const RenderOptions& render_options,
+               const HdrBuffer&     output,
+               RenderStats*         stats) {
+    const size_t stride = HdrStride(output);
+    if (output.width != camera_options.screen_width || output.height != camera_options.screen_height) {
+        throw std::logic_error("Buffer size doesn't match the screen");
+    }
+
+    // NB: Without adaptive sampling rows don't depend on each other, so only
+    // a band of them is staged as doubles. Adaptive sampling compares pixels
+    // across the whole frame, which is staged at once then.
+    const int width     = output.width;
+    const int height    = output.height;
+    const int band_rows = render_options.max_samples > 1 ? height : kHdrBandRows;
+    const int channels  = output.channels;
+
+    Matf        mat;
+    RenderStats band_stats;
+    for (int y0 = 0; y0 < height; y0 += band_rows) {
+        const int rows = std::min(band_rows, height - y0);
+        if (static_cast<int>(mat.GetH()) != rows) {
+            mat = Matf(width, rows);
+        }
+        RenderFrame(scene, camera_options, render_options, FrameHooks{}, stats ? &band_stats : nullptr,
+                    &mat, y0);
+        if (stats) {
+            AddStats(band_stats, y0 == 0, stats);
+        }
+
+        ForRows(rows, render_options.num_threads, [&](int y) {
+            const Vec3f* in  = mat.Row(y);
+            float*       out = output.data + (y0 + y) * stride;
+            for (int x = 0; x < width; ++x, out += channels) {
+                out[0] = static_cast<float>(in[x].x);
+                out[1] = static_cast<float>(in[x].y);
+                out[2] = static_cast<float>(in[x].z);
+                if (channels == 4) {
+                    out[3] = 1.0f;
+                }
+            }
+        });
+    }
+}
+
+std::vector<float> RenderHdr(const Scene&         scene,
+                             const CameraOptions& camera_options,
+                             const RenderOptions& render_options,
+                             RenderStats*         stats) {
+    const int width  = camera_options.screen_width;
+    const int height = camera_options.screen_height;
+    std::vector<float> radiance(static_cast<size_t>(width) * height * 3);
+    RenderHdr(scene, camera_options, render_options, HdrBuffer{radiance.data(), width, height}, stats);
+    return radiance;
+}
+
+void ToneMapHdr(const HdrBuffer& input, Image* image, int num_threads) {
+    const size_t stride = HdrStride(input);
+    if (image->Width() != input.width || image->Height() != input.height) {
+        throw std::logic_error("Image size doesn't match the buffer");
+    }
+
+    // NB: The kernels work on doubles, rows are widened one at a time.
+    auto row = [&](int y) {
+        static thread_local std::vector<Vec3f> widened;
+        widened.resize(input.width);
+        const float* in = input.data + y * stride;
+        for (int x = 0; x < input.width; ++x, in += input.channels) {
+            widened[x] = Vec3f{in[0], in[1], in[2]};
+        }
+        return static_cast<const Vec3f*>(widened.data());
+    };
+    ToneMapFrame(num_threads, row, image);
+}
+
+Image ToneMapHdr(const HdrBuffer& input, int num_threads) {
+    Image image(input.width, input.height, 3);
+    ToneMapHdr(input, &image, num_threads);
+    return image;
+}
+
+// NB: Largest channel of the pixel centers on a grid of the given step,
+// brighter pixels in between saturate. Rows are reduced as they are traced,
+// the coarse frame is never stored.
+static double EstimateToneMax(const Scene&         scene,
+                              const CameraOptions& camera_options,
+                              const RenderOptions& render_options,
+                              int                  step) {
+    const int width  = (camera_options.screen_width + step - 1) / step;
+    const int height = (camera_options.screen_height + step - 1) / step;
 
     Options options{camera_options, render_options};
+    Camera  camera{camera_options};
 
-    Vec3f from = Vec3f{camera_options.look_from};
-    Vec3f to = Vec3f{camera_options.look_to};
+    std::vector<double> row_max(height, std::numeric_limits<double>::min());
+    ForRows(height, render_options.num_threads, [&](int j) {
+        double C = row_max[j];
+        for (int i = 0; i < width; ++i) {
+            const Vec3f pixel = Trace(camera.GetRay(i * step + 0.5, j * step + 0.5), scene, options);
+            C = std::max({C, pixel.x, pixel.y, pixel.z});
+        }
+        row_max[j] = C;
+    });
+    double C = std::numeric_limits<double>::min();
+    for (auto max : row_max) {
+        C = std::max(C, max);
+    }
+    return C;
+}
 
-    // FIXME: Ugly stub !!!!
-    Vec3f tmp =
-        (from - to).normalize().cross(Vec3f{0, 1, 0}).IsZero() ? Vec3f{0, 0, -1} : Vec3f{0, 1, 0};
+void RenderStreamed(const Scene&         scene,
+                    const CameraOptions& camera_options,
+                    const RenderOptions& render_options,
+                    const StreamOptions& stream_options,
+                    const BandCallback&  on_band) {
+    const int width  = camera_options.screen_width;
+    const int height = camera_options.screen_height;
 
-    // Init image & Mat
-    Image img(width, height);
-    Matf  mat(width, height);
+    if (stream_options.band_height <= 0) {
+        throw std::logic_error("Band height must be positive");
+    }
+    if (stream_options.tone_max < 0 ||
+        (stream_options.tone_max == 0 && stream_options.estimate_step <= 0)) {
+        throw std::logic_error("Tone mapping needs a positive maximum or estimate step");
+    }
 
-    double scale = std::tan(fov * 0.5);
-    double ratio = width / static_cast<double>(height);
+    const double C = stream_options.tone_max > 0
+                         ? stream_options.tone_max
+                         : EstimateToneMax(scene, camera_options, render_options,
+                                           stream_options.estimate_step);
 
-    Vec3f forward = (from - to).normalize();
-    Vec3f right = tmp.cross(forward).normalize();
-    Vec3f up = forward.cross(right).normalize();
+    // NB: Reused by every band but the last, shorter one.
+    Matf  mat;
+    Image band;
+    for (int y0 = 0; y0 < height; y0 += stream_options.band_height) {
+        const int rows = std::min(stream_options.band_height, height - y0);
+        if (static_cast<int>(mat.GetH()) != rows) {
+            mat  = Matf(width, rows);
+            band = Image(width, rows, 3);
+        }
+        RenderFrame(scene, camera_options, render_options, FrameHooks{}, nullptr, &mat, y0);
+        ToneMapRows(render_options.num_threads, C, [&](int y) { return mat.Row(y); }, &band);
+        on_band(band, y0);
+    }
+}
 
-#pragma omp parallel for
+void RenderToPng(const Scene&         scene,
+                 const CameraOptions& camera_options,
+                 const RenderOptions& render_options,
+                 const StreamOptions& stream_options,
+                 const std::string&   filename) {
+    PngWriter writer(filename, camera_options.screen_width, camera_options.screen_height);
+    RenderStreamed(scene, camera_options, render_options, stream_options,
+                   [&](const Image& band, int) {
+                       for (int y = 0; y < band.Height(); ++y) {
+                           writer.WriteRow(band.Row(y));
+                       }
+                   });
+    writer.Finish();
+}
+
+Image RenderWavefront(const Scene&         scene,
+                      const CameraOptions& camera_options,
+                      const RenderOptions& render_options,
+                      RenderStats*         stats) {
+    // NB: Camera rays traced as one batch, bounds the size of the queues.
+    static constexpr int kBatchSize = 1 << 16;
+    static constexpr int kChunkSize = 1024;
+
+    const int width  = camera_options.screen_width;
+    const int height = camera_options.screen_height;
+    const int64_t pixels = static_cast<int64_t>(width) * height;
+
+    Options         options{camera_options, render_options};
+    Camera          camera{camera_options};
+    WavefrontTracer tracer(scene, options);
+
+    std::vector<Vec3f>        radiance(pixels, Vec3f{0.0, 0.0, 0.0});
+    std::vector<WavefrontRay> rays;
+    double                    camera_ms = 0.0;
+
+    for (int64_t first = 0; first < pixels; first += kBatchSize) {
+        const int count = static_cast<int>(std::min<int64_t>(kBatchSize, pixels - first));
+
+        using namespace std::chrono;
+        auto start = high_resolution_clock::now();
+        rays.resize(count);
+        ParallelFor((count + kChunkSize - 1) / kChunkSize, render_options.num_threads, [&](int chunk) {
+            for (int k = chunk * kChunkSize; k < std::min(count, (chunk + 1) * kChunkSize); ++k) {
+                const int64_t pixel = first + k;
+                const int     i     = static_cast<int>(pixel % width);
+                const int     j     = static_cast<int>(pixel / width);
+                rays[k] = WavefrontRay{PathRay{camera.GetRay(i + 0.5, j + 0.5),
+                                               Vec3f{1.0, 1.0, 1.0}, 0, true},
+                                       pixel};
+            }
+        });
+        auto end = high_resolution_clock::now();
+        camera_ms += duration<double, std::milli>(end - start).count();
+
+        tracer.Trace(&rays, &radiance);
+    }
+
+    if (stats) {
+        stats->samples   = pixels;
+        stats->wavefront = tracer.GetStats();
+        stats->wavefront.camera_ms = camera_ms;
+    }
+
+    Matf mat(width, height);
     for (int j = 0; j < height; ++j) {
         for (int i = 0; i < width; ++i) {
-            // FIXME: Should it be without static_cast ???
-            double ps_x = (i + 0.5) / static_cast<double>(width);
-            double ps_y = (j + 0.5) / static_cast<double>(height);
+            mat(i, j) = radiance[static_cast<size_t>(j) * width + i];
+        }
+    }
+    return ToImage(mat, render_options.num_threads);
+}
 
-            double x = (2 * ps_x - 1) * scale * ratio;
-            double y = (1 - 2 * ps_y) * scale;
+Image RenderCheckpointed(const Scene&             scene,
+                         const CameraOptions&     camera_options,
+                         const RenderOptions&     render_options,
+                         const CheckpointOptions& checkpoint_options,
+                         RenderStats*             stats) {
+    const int width  = camera_options.screen_width;
+    const int height = camera_options.screen_height;
 
-            Vec3f view{x, y, -1};
-            Vec3f zero{0, 0, 0};
+    if (render_options.max_samples > 1) {
+        throw std::logic_error("Adaptive sampling can't be checkpointed");
+    }
+    if (!(checkpoint_options.interval_ms > 0)) {
+        throw std::logic_error("Checkpoint interval must be positive");
+    }
+
+    // NB: The tile grid of RenderFrame, the scheduler validates the size.
+    const int    size      = render_options.tile_size;
+    const size_t num_tiles = TileScheduler(width, height, size, 1).GetTiles().size();
+    const int    tiles_x   = (width + size - 1) / size;
+
+    Checkpoint checkpoint{width, height, size,
+                          CheckpointFingerprint(scene, camera_options, render_options),
+                          std::vector<char>(num_tiles, 0)};
+    Matf mat(width, height);
+
+    Checkpoint resumed;
+    if (ReadCheckpoint(checkpoint_options.path, &resumed, &mat)) {
+        if (resumed.fingerprint != checkpoint.fingerprint || resumed.tile_size != size) {
+            throw std::logic_error("Checkpoint " + checkpoint_options.path +
+                                   " was written with a different scene or options");
+        }
+        checkpoint.done = resumed.done;
+    }
+
+    // NB: Set by render threads once a tile is final, read by the writer.
+    std::unique_ptr<std::atomic<bool>[]> done(new std::atomic<bool>[checkpoint.done.size()]);
+    for (size_t k = 0; k < checkpoint.done.size(); ++k) {
+        done[k] = checkpoint.done[k];
+    }
+    auto index = [&](const Tile& tile) { return (tile.y0 / size) * tiles_x + tile.x0 / size; };
+
+    // NB: Finished tiles are never written again, so the writer reads them
+    // without locks while the others are rendered.
+    auto write = [&]() {
+        for (size_t k = 0; k < checkpoint.done.size(); ++k) {
+            checkpoint.done[k] = done[k].load(std::memory_order_acquire);
+        }
+        WriteCheckpoint(checkpoint_options.path, checkpoint, mat);
+    };
+
+    // NB: Fails early if the checkpoint can't be written.
+    write();
 
-            Ray ray;
+    // NB: Later failures lose at most an interval of work, so the render
+    // goes on.
+    auto try_write = [&]() {
+        try {
+            write();
+        } catch (const std::exception& e) {
+            const std::string message = std::string("Checkpoint failed: ") + e.what();
+            if (checkpoint_options.on_error) {
+                checkpoint_options.on_error(message);
+            } else {
+                std::cerr << "[WARNING] " << message << std::endl;
+            }
+        }
+    };
 
-            ray.orig = Vec3f{zero.dot(Vec3f{right.x, up.x, forward.x}) + from.x,
-                             zero.dot(Vec3f{right.y, up.y, forward.y}) + from.y,
-                             zero.dot(Vec3f{right.z, up.z, forward.z}) + from.z};
+    std::mutex              mutex;
+    std::condition_variable cv;
+    bool                    finished = false;
 
-            auto p = Vec3f{view.dot(Vec3f{right.x, up.x, forward.x}) + from.x,
-                           view.dot(Vec3f{right.y, up.y, forward.y}) + from.y,
-                           view.dot(Vec3f{right.z, up.z, forward.z}) + from.z};
+    std::thread writer([&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        const auto interval = std::chrono::duration<double, std::milli>(checkpoint_options.interval_ms);
+        while (!cv.wait_for(lock, interval, [&]() { return finished; })) {
+            try_write();
+        }
+    });
 
-            ray.dir = (p - ray.orig).normalize();
+    FrameHooks hooks;
+    hooks.skip    = [&](const Tile& tile) { return done[index(tile)].load(std::memory_order_relaxed); };
+    hooks.on_tile = [&](const Tile& tile, const Matf&) {
+        done[index(tile)].store(true, std::memory_order_release);
+    };
 
-            Vec3f intensity = Trace(ray, scene, options);
-            mat[i][j] = intensity;
+    auto stop = [&]() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished = true;
         }
+        cv.notify_all();
+        writer.join();
+    };
+
+    try {
+        RenderFrame(scene, camera_options, render_options, hooks, stats, &mat);
+    } catch (...) {
+        stop();
+        // NB: Keeps the tiles finished since the last checkpoint, the
+        // render error is the one rethrown.
+        try_write();
+        throw;
     }
+    stop();
 
-    postprocessing(mat);
+    std::remove(checkpoint_options.path.c_str());
+    return ToImage(mat, render_options.num_threads);
+}
+
+Image RenderBudgeted(const Scene&         scene,
+                     const CameraOptions& camera_options,
+                     const RenderOptions& render_options,
+                     double               budget_ms,
+                     RenderQuality*       quality) {
+    using namespace std::chrono;
+    const auto start = steady_clock::now();
+
+    // NB: Budgets the clock can't represent, e.g. infinity, never run out.
+    // Half of its range is kept as a margin for rounding to double, which
+    // still leaves centuries.
+    const double max_ms =
+            duration<double, std::milli>(steady_clock::time_point::max() - start).count() / 2;
+    auto deadline = steady_clock::time_point::max();
+    if (budget_ms <= 0) {
+        deadline = start;
+    } else if (budget_ms < max_ms) {
+        deadline = start + duration_cast<steady_clock::duration>(duration<double, std::milli>(budget_ms));
+    }
+
+    const int width  = camera_options.screen_width;
+    const int height = camera_options.screen_height;
+
+    if (render_options.max_samples < 1) {
+        throw std::logic_error("Samples per pixel must be positive");
+    }
+
+    Options       options{camera_options, render_options};
+    Camera        camera{camera_options};
+    TileScheduler scheduler(width, height, render_options.tile_size, render_options.num_threads);
+
+    // NB: Runs a pass unless the budget has run out, which cancels the pass
+    // between tiles. Returns whether the pass has covered every tile.
+    auto run = [&](const std::function<void(int, int)>& f) {
+        return scheduler.Run([&](const Tile& tile, int) {
+            if (steady_clock::now() >= deadline) {
+                scheduler.Cancel();
+                return;
+            }
+            for (int j = tile.y0; j < tile.y1; ++j) {
+                for (int i = tile.x0; i < tile.x1; ++i) {
+                    f(i, j);
+                }
+            }
+        });
+    };
+
+    Matf              preview(width, height);
+    std::vector<char> previewed(static_cast<size_t>(width) * height, 0);
+    Matf              sum(width, height);
+    std::vector<int>  samples(static_cast<size_t>(width) * height, 0);
+
+    bool complete = true;
+    if (render_options.depth > 1) {
+        Options preview_options = options;
+        preview_options.render_options.depth = 1;
+        complete = run([&](int i, int j) {
+            preview(i, j) = Trace(camera.GetRay(i + 0.5, j + 0.5), scene, preview_options);
+            previewed[j * width + i] = 1;
+        });
+    }
+    if (complete) {
+        complete = run([&](int i, int j) {
+            sum(i, j) = Trace(camera.GetRay(i + 0.5, j + 0.5), scene, options);
+            samples[j * width + i] = 1;
+        });
+    }
+    for (int pass = 1; complete && pass < render_options.max_samples; ++pass) {
+        complete = run([&](int i, int j) {
+            sum(i, j) += Trace(camera.GetRay(i + Jitter(i, j, pass, 0), j + Jitter(i, j, pass, 1)),
+                               scene, options);
+            samples[j * width + i] += 1;
+        });
+    }
 
+    Matf mat(width, height);
+    int  min_samples = std::numeric_limits<int>::max();
+    int  max_samples = 0;
+    bool all_previewed = true;
+    int  covered = 0;
     for (int j = 0; j < height; ++j) {
         for (int i = 0; i < width; ++i) {
-            img.SetPixel(toRGB(mat[i][j]), j, i);
+            const int n = samples[j * width + i];
+            if (n > 0) {
+                mat(i, j) = n == 1 ? sum(i, j) : sum(i, j) / n;
+                ++covered;
+            } else if (previewed[j * width + i]) {
+                mat(i, j) = preview(i, j);
+            } else {
+                all_previewed = false;
+            }
+            min_samples = std::min(min_samples, n);
+            max_samples = std::max(max_samples, n);
+        }
+    }
+
+    if (quality) {
+        const int pixels = width * height;
+        quality->depth       = covered == pixels ? render_options.depth : (all_previewed ? 1 : 0);
+        quality->min_samples = pixels > 0 ? min_samples : 0;
+        quality->max_samples = max_samples;
+        quality->coverage    = pixels > 0 ? static_cast<double>(covered) / pixels : 1.0;
+        quality->elapsed_ms  = duration<double, std::milli>(steady_clock::now() - start).count();
+        quality->complete    = complete;
+    }
+
+    return ToImage(mat, render_options.num_threads);
+}
+
+Image RenderPreview(const Scene&           scene,
+                    const CameraOptions&   camera_options,
+                    const RenderOptions&   render_options,
+                    const PreviewCallback& on_level) {
+    const int width  = camera_options.screen_width;
+    const int height = camera_options.screen_height;
+
+    const int first_step = std::max(1, render_options.preview_step);
+    if (first_step & (first_step - 1)) {
+        throw std::logic_error("Preview step must be a power of two");
+    }
+
+    Options       options{camera_options, render_options};
+    Camera        camera{camera_options};
+    TileScheduler scheduler(width, height, render_options.tile_size, render_options.num_threads);
+
+    Matf mat(width, height);
+    for (int step = first_step; step >= 1; step /= 2) {
+        // NB: Pixels on the grid of the previous level are traced already.
+        const int prev = step * 2;
+        scheduler.Run([&](const Tile& tile, int) {
+            for (int j = tile.y0 + (step - tile.y0 % step) % step; j < tile.y1; j += step) {
+                for (int i = tile.x0 + (step - tile.x0 % step) % step; i < tile.x1; i += step) {
+                    if (step < first_step && i % prev == 0 && j % prev == 0) {
+                        continue;
+                    }
+                    mat(i, j) = Trace(camera.GetRay(i + 0.5, j + 0.5), scene, options);
+                }
+            }
+        });
+
+        if (step == 1) {
+            break;
+        }
+
+        if (!on_level) {
+            continue;
+        }
+
+        // NB: Tone maps the traced pixels only, then fills the blocks.
+        Matf coarse((width + step - 1) / step, (height + step - 1) / step);
+        for (int j = 0; j < coarse.GetH(); ++j) {
+            for (int i = 0; i < coarse.GetW(); ++i) {
+                coarse(i, j) = mat(i * step, j * step);
+            }
         }
+        const auto small = ToImage(coarse, render_options.num_threads);
+
+        // NB: RGB like the final image.
+        Image level(width, height, 3);
+        for (int j = 0; j < height; ++j) {
+            for (int i = 0; i < width; ++i) {
+                level.SetPixel(small.GetPixel(j / step, i / step), j, i);
+            }
+        }
+        on_level(level, step);
     }
 
-    return img;
+    auto image = ToImage(mat, render_options.num_threads);
+    if (on_level) {
+        on_level(image, 1);
+    }
+    return image;
 }
 
 Image Render(const std::string& filename, const CameraOptions& camera_options,
@@ -118,3 +960,188 @@ Image Render(const std::string& filename, const CameraOptions& camera_options,
     const auto scene = Parse(filename);
     return Render(Parse(filename), camera_options, render_options);
 }
+
+/* ############################################# ProgressiveRenderer ########################################## */
+
+struct ProgressiveRenderer::Impl {
+    Impl(const Scene& scene, const CameraOptions& camera_options, const RenderOptions& render_options)
+        : scene(scene),
+          options{camera_options, render_options},
+          camera(camera_options),
+          scheduler(camera_options.screen_width, camera_options.screen_height,
+                    render_options.tile_size, render_options.num_threads),
+          sum(camera_options.screen_width, camera_options.screen_height) {
+    }
+
+    const Scene&  scene;
+    Options       options;
+    Camera        camera;
+    TileScheduler scheduler;
+    // NB: Sum of all samples of every pixel.
+    Matf          sum;
+    int           passes = 0;
+};
+
+ProgressiveRenderer::ProgressiveRenderer(const Scene&         scene,
+                                         const CameraOptions& camera_options,
+                                         const RenderOptions& render_options)
+    : _impl(new Impl{scene, camera_options, render_options}) {
+}
+
+Image ProgressiveRenderer::RenderPass() {
+    auto& impl = *_impl;
+    const int pass = impl.passes;
+
+    impl.scheduler.Run([&](const Tile& tile, int) {
+        for (int j = tile.y0; j < tile.y1; ++j) {
+            for (int i = tile.x0; i < tile.x1; ++i) {
+                // NB: The first pass samples pixel centers, so it matches Render.
+                double dx = pass == 0 ? 0.5 : Jitter(i, j, pass, 0);
+                double dy = pass == 0 ? 0.5 : Jitter(i, j, pass, 1);
+                impl.sum(i, j) += Trace(impl.camera.GetRay(i + dx, j + dy), impl.scene, impl.options);
+            }
+        }
+    });
+
+    ++impl.passes;
+    return GetSnapshot();
+}
+
+Image ProgressiveRenderer::GetSnapshot() const {
+    const auto& impl = *_impl;
+    Matf mean(impl.sum.GetW(), impl.sum.GetH());
+    if (impl.passes > 0) {
+        for (int j = 0; j < mean.GetH(); ++j) {
+            for (int i = 0; i < mean.GetW(); ++i) {
+                mean(i, j) = impl.sum(i, j) / impl.passes;
+            }
+        }
+    }
+    return ToImage(mean, impl.options.render_options.num_threads);
+}
+
+int ProgressiveRenderer::GetPassCount() const {
+    return _impl->passes;
+}
+
+const std::vector<ThreadStats>& ProgressiveRenderer::GetStats() const {
+    return _impl->scheduler.GetStats();
+}
+
+/* ############################################# RenderHandle ################################################# */
+
+struct RenderHandle::State {
+    std::thread thread;
+
+    std::atomic<bool> cancelled{false};
+    std::atomic<int>  tiles_done{0};
+    int               num_tiles = 0;
+
+    std::mutex              mutex;
+    std::condition_variable cv;
+    bool                    done = false;
+    // NB: RenderFrame went through every tile, a later Cancel is ignored.
+    bool                    completed = false;
+    Image                   image;
+    RenderStats             stats;
+    std::exception_ptr      error;
+};
+
+RenderHandle RenderAsync(const Scene&         scene,
+                         const CameraOptions& camera_options,
+                         const RenderOptions& render_options,
+                         TileCallback         on_tile) {
+    auto state = std::make_shared<RenderHandle::State>();
+
+    const int tile_size = std::max(1, render_options.tile_size);
+    const int tiles_x   = (camera_options.screen_width + tile_size - 1) / tile_size;
+    const int tiles_y   = (camera_options.screen_height + tile_size - 1) / tile_size;
+    state->num_tiles = tiles_x * tiles_y * NumPasses(render_options);
+
+    state->thread = std::thread([state, &scene, camera_options, render_options,
+                                 on_tile = std::move(on_tile)]() {
+        Image              image;
+        RenderStats        stats;
+        std::exception_ptr error;
+        bool               completed = false;
+        try {
+            FrameHooks hooks;
+            hooks.cancelled  = &state->cancelled;
+            hooks.tiles_done = &state->tiles_done;
+            hooks.on_tile    = on_tile;
+            Matf mat(camera_options.screen_width, camera_options.screen_height);
+            if (RenderFrame(scene, camera_options, render_options, hooks, &stats, &mat)) {
+                image     = ToImage(mat, render_options.num_threads);
+                completed = true;
+            }
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->image     = std::move(image);
+        state->stats     = std::move(stats);
+        state->error     = error;
+        state->completed = completed;
+        state->done      = true;
+        state->cv.notify_all();
+    });
+
+    return RenderHandle(std::move(state));
+}
+
+RenderHandle::RenderHandle(std::shared_ptr<State> state) : _state(std::move(state)) {
+}
+
+RenderHandle::~RenderHandle() {
+    if (_state && _state->thread.joinable()) {
+        _state->cancelled = true;
+        _state->thread.join();
+    }
+}
+
+double RenderHandle::GetProgress() const {
+    if (_state->num_tiles == 0) {
+        return IsDone() ? 1.0 : 0.0;
+    }
+    return std::min(1.0, static_cast<double>(_state->tiles_done) / _state->num_tiles);
+}
+
+void RenderHandle::Cancel() {
+    _state->cancelled = true;
+}
+
+bool RenderHandle::IsDone() const {
+    std::lock_guard<std::mutex> lock(_state->mutex);
+    return _state->done;
+}
+
+bool RenderHandle::WaitFor(double ms) const {
+    std::unique_lock<std::mutex> lock(_state->mutex);
+    return _state->cv.wait_for(lock, std::chrono::duration<double, std::milli>(ms),
+                               [&]() { return _state->done; });
+}
+
+Image RenderHandle::Get() {
+    {
+        std::unique_lock<std::mutex> lock(_state->mutex);
+        _state->cv.wait(lock, [&]() { return _state->done; });
+    }
+    if (_state->thread.joinable()) {
+        _state->thread.join();
+    }
+    if (_state->error) {
+        std::rethrow_exception(_state->error);
+    }
+    if (!_state->completed) {
+        throw RenderCancelled();
+    }
+    return _state->image;
+}
+
+const RenderStats& RenderHandle::GetStats() const {
+    // NB: The stats are written once, before done is set.
+    std::unique_lock<std::mutex> lock(_state->mutex);
+    _state->cv.wait(lock, [&]() { return _state->done; });
+    return _state->stats;
+}
@@ -0,0 +1,235 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <stdexcept>
+
+#include <raytracer/scheduler.hpp>
+
+/* ############################################# Morton order ################################################# */
+
+static uint32_t SpreadBits(uint32_t v) {
+    v &= 0x0000ffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+uint32_t MortonCode(uint32_t x, uint32_t y) {
+    return SpreadBits(x) | (SpreadBits(y) << 1);
+}
+
+/* ############################################# TileScheduler Implementation ################################# */
+
+TileScheduler::TileScheduler(int width, int height, int tile_size, int num_threads)
+    : _num_threads(num_threads) {
+    if (tile_size <= 0) {
+        throw std::logic_error("Tile size must be positive");
+    }
+    if (_num_threads <= 0) {
+        _num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    struct Entry {
+        uint32_t code;
+        Tile     tile;
+    };
+
+    std::vector<Entry> entries;
+    for (int ty = 0; ty * tile_size < height; ++ty) {
+        for (int tx = 0; tx * tile_size < width; ++tx) {
+            Tile tile{tx * tile_size, ty * tile_size,
+                      std::min((tx + 1) * tile_size, width),
+                      std::min((ty + 1) * tile_size, height)};
+            entries.push_back(Entry{MortonCode(tx, ty), tile});
+        }
+    }
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry& a, const Entry& b) { return a.code < b.code; });
+
+    for (const auto& e : entries) {
+        _tiles.push_back(e.tile);
+    }
+}
+
+// NB: Runs worker(t) on num_threads - 1 new threads and worker(0) on the
+// calling one, then joins them. If a thread can't be started, stop is set,
+// the ones already running are joined and the error is rethrown.
+template <typename F>
+static void RunWorkers(int num_threads, std::atomic<bool>* stop, F&& worker) {
+    std::vector<std::thread> threads;
+    try {
+        for (int t = 1; t < num_threads; ++t) {
+            threads.emplace_back(worker, t);
+        }
+    } catch (...) {
+        *stop = true;
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        throw;
+    }
+    worker(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+bool TileScheduler::Run(const std::function<void(const Tile&, int)>& f) {
+    using namespace std::chrono;
+    _cancelled = false;
+
+    // NB: Padded to keep the locks of neighbour queues on different cache lines.
+    struct alignas(64) Queue {
+        std::mutex      mutex;
+        std::deque<int> tiles;
+    };
+
+    const int num_tiles = static_cast<int>(_tiles.size());
+    std::vector<Queue> queues(_num_threads);
+    for (int t = 0; t < _num_threads; ++t) {
+        const int first = static_cast<int>(static_cast<int64_t>(num_tiles) * t / _num_threads);
+        const int last  = static_cast<int>(static_cast<int64_t>(num_tiles) * (t + 1) / _num_threads);
+        for (int i = first; i < last; ++i) {
+            queues[t].tiles.push_back(i);
+        }
+    }
+
+    _stats.assign(_num_threads, ThreadStats{});
+
+    auto pop = [&](int thread, int* tile) {
+        auto& queue = queues[thread];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tiles.empty()) {
+            return false;
+        }
+        *tile = queue.tiles.front();
+        queue.tiles.pop_front();
+        return true;
+    };
+
+    auto steal = [&](int thread, int* tile) {
+        for (int k = 1; k < _num_threads; ++k) {
+            auto& queue = queues[(thread + k) % _num_threads];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (!queue.tiles.empty()) {
+                *tile = queue.tiles.back();
+                queue.tiles.pop_back();
+                return true;
+            }
+        }
+        return false;
+    };
+
+    // NB: The first exception thrown by f stops every thread
+    // and is rethrown by Run.
+    std::exception_ptr error;
+    std::mutex         error_mutex;
+    std::atomic<bool>  failed{false};
+
+    // NB: No work is added while running, so a thread which finds every
+    // queue empty is done.
+    auto worker = [&](int thread) {
+        auto& stats = _stats[thread];
+        int tile = 0;
+        while (!failed && !_cancelled) {
+            bool stolen = false;
+            if (!pop(thread, &tile)) {
+                if (!steal(thread, &tile)) {
+                    break;
+                }
+                stolen = true;
+            }
+
+            auto start = high_resolution_clock::now();
+            try {
+                f(_tiles[tile], thread);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+                failed = true;
+            }
+            auto end   = high_resolution_clock::now();
+
+            stats.busy_ms += duration<double, std::milli>(end - start).count();
+            stats.tiles   += 1;
+            stats.stolen  += stolen;
+        }
+    };
+
+    auto start = high_resolution_clock::now();
+
+    RunWorkers(_num_threads, &failed, worker);
+
+    auto end = high_resolution_clock::now();
+    const double wall = duration<double, std::milli>(end - start).count();
+    for (auto& stats : _stats) {
+        stats.idle_ms = std::max(0.0, wall - stats.busy_ms);
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    return !_cancelled;
+}
+
+void TileScheduler::Cancel() {
+    _cancelled = true;
+}
+
+const std::vector<Tile>& TileScheduler::GetTiles() const {
+    return _tiles;
+}
+
+int TileScheduler::GetNumThreads() const {
+    return _num_threads;
+}
+
+const std::vector<ThreadStats>& TileScheduler::GetStats() const {
+    return _stats;
+}
+
+/* ############################################# ParallelFor ################################################## */
+
+void ParallelFor(int count, int num_threads, const std::function<void(int)>& f) {
+    if (num_threads <= 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    num_threads = std::max(1, std::min(num_threads, count));
+
+    std::atomic<int>   next{0};
+    std::exception_ptr error;
+    std::mutex         error_mutex;
+    std::atomic<bool>  failed{false};
+
+    auto worker = [&](int) {
+        while (!failed) {
+            const int i = next++;
+            if (i >= count) {
+                break;
+            }
+            try {
+                f(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+                failed = true;
+            }
+        }
+    };
+
+    RunWorkers(num_threads, &failed, worker);
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
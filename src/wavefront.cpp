@@ -0,0 +1,229 @@
+#include <chrono>
+#include <optional>
+#include <algorithm>
+
+#include <raytracer/wavefront.hpp>
+#include <raytracer/scheduler.hpp>
+
+// NB: Rays handed to a thread at once.
+static constexpr int kChunkSize = 1024;
+
+static int NumChunks(size_t count) {
+    return static_cast<int>((count + kChunkSize - 1) / kChunkSize);
+}
+
+// NB: Calls f(chunk, begin, end) for consecutive chunks of [0, count).
+template <typename F>
+static void ForChunks(size_t count, int num_threads, F&& f) {
+    ParallelFor(NumChunks(count), num_threads, [&](int chunk) {
+        const size_t begin = static_cast<size_t>(chunk) * kChunkSize;
+        const size_t end   = std::min(count, begin + kChunkSize);
+        f(chunk, begin, end);
+    });
+}
+
+template <typename F>
+static void Timed(double* ms, F&& f) {
+    using namespace std::chrono;
+    auto start = high_resolution_clock::now();
+    f();
+    auto end   = high_resolution_clock::now();
+    *ms += duration<double, std::milli>(end - start).count();
+}
+
+/* ############################################# Ray sorting ################################################## */
+
+static uint64_t SpreadBits3(uint64_t v) {
+    v &= 0x3ff;
+    v = (v | (v << 16)) & 0x30000ff;
+    v = (v | (v << 8))  & 0x300f00f;
+    v = (v | (v << 4))  & 0x30c30c3;
+    v = (v | (v << 2))  & 0x9249249;
+    return v;
+}
+
+static uint64_t Quantize(double v, double lo, double hi) {
+    static constexpr double kMax = 1023;
+    if (!(hi > lo)) {
+        return 0;
+    }
+    const double q = (v - lo) / (hi - lo) * kMax;
+    return static_cast<uint64_t>(std::max(0.0, std::min(q, kMax)));
+}
+
+uint64_t SortKey(const Ray& ray, const AABB& bounds) {
+    const uint64_t octant = (ray.dir.x < 0) | (ray.dir.y < 0) << 1 | (ray.dir.z < 0) << 2;
+    const uint64_t x = Quantize(ray.orig.x, bounds.lo.x, bounds.hi.x);
+    const uint64_t y = Quantize(ray.orig.y, bounds.lo.y, bounds.hi.y);
+    const uint64_t z = Quantize(ray.orig.z, bounds.lo.z, bounds.hi.z);
+    return octant << 30 | SpreadBits3(x) | SpreadBits3(y) << 1 | SpreadBits3(z) << 2;
+}
+
+/* ############################################# WavefrontTracer Implementation ############################### */
+
+WavefrontTracer::WavefrontTracer(const Scene& scene, const Options& options)
+    : _scene(scene), _options(options), _bounds(scene.GetBVH().GetBounds()) {
+}
+
+void WavefrontTracer::SortRays(std::vector<WavefrontRay>* rays) {
+    // NB: Ties are broken by position, so the order is deterministic.
+    _keys.resize(rays->size());
+    for (size_t k = 0; k < rays->size(); ++k) {
+        _keys[k] = {SortKey((*rays)[k].path.ray, _bounds), static_cast<int>(k)};
+    }
+    std::sort(_keys.begin(), _keys.end());
+
+    _sorted.resize(rays->size());
+    for (size_t k = 0; k < _keys.size(); ++k) {
+        _sorted[k] = (*rays)[_keys[k].second];
+    }
+    rays->swap(_sorted);
+}
+
+void WavefrontTracer::Trace(std::vector<WavefrontRay>* queue, std::vector<Vec3f>* radiance) {
+    auto& rays = *queue;
+    const int num_threads = _options.render_options.num_threads;
+
+    rays.erase(std::remove_if(rays.begin(), rays.end(),
+                              [&](const WavefrontRay& ray) {
+                                  return ray.path.depth == _options.render_options.depth;
+                              }),
+               rays.end());
+
+    auto& hits   = _hits;
+    auto& chunks = _chunks;
+    const bool sort = _options.render_options.sort_rays;
+
+    // NB: Nodes visited by the traversals of a chunk.
+    std::vector<int64_t> nodes;
+
+    // NB: Camera rays are coherent already.
+    bool secondary = false;
+    while (!rays.empty()) {
+        _stats.waves += 1;
+        _stats.rays  += static_cast<int64_t>(rays.size());
+
+        if (sort && secondary) {
+            Timed(&_stats.sort_ms, [&]() { SortRays(&rays); });
+        }
+        secondary = true;
+
+        Timed(&_stats.intersect_ms, [&]() {
+            hits.assign(rays.size(), std::nullopt);
+            nodes.assign(NumChunks(rays.size()), 0);
+            ForChunks(rays.size(), num_threads, [&](int c, size_t begin, size_t end) {
+                const int64_t visited = GetTraversalCounters().nodes;
+                for (size_t k = begin; k < end; ++k) {
+                    hits[k] = _scene.Intersect(rays[k].path.ray);
+                }
+                nodes[c] = GetTraversalCounters().nodes - visited;
+            });
+            for (auto n : nodes) {
+                _stats.nodes += n;
+            }
+        });
+
+        Timed(&_stats.shade_ms, [&]() {
+            chunks.resize(std::max(chunks.size(), static_cast<size_t>(NumChunks(rays.size()))));
+            ForChunks(rays.size(), num_threads, [&](int c, size_t begin, size_t end) {
+                auto& chunk = chunks[c];
+                chunk.shaded.clear();
+                chunk.lights.clear();
+                chunk.rays.clear();
+                std::vector<PathRay> branches;
+                for (size_t k = begin; k < end; ++k) {
+                    if (!hits[k]) {
+                        continue;
+                    }
+                    const auto& ray   = rays[k];
+                    const size_t first = chunk.lights.size();
+                    branches.clear();
+                    auto shading = ShadeSurface(ray.path, hits[k].value(), _scene, _options,
+                                                &chunk.lights, &branches);
+                    chunk.shaded.push_back(Shaded{ray.pixel, ray.path.weight, shading, first,
+                                                  chunk.lights.size() - first});
+                    for (const auto& branch : branches) {
+                        chunk.rays.push_back(WavefrontRay{branch, ray.pixel});
+                    }
+                }
+            });
+        });
+
+        const int num_chunks = NumChunks(rays.size());
+
+        if (!sort) {
+            Timed(&_stats.shadow_ms, [&]() {
+                nodes.assign(num_chunks, 0);
+                ParallelFor(num_chunks, num_threads, [&](int c) {
+                    const int64_t visited = GetTraversalCounters().nodes;
+                    auto& chunk = chunks[c];
+                    chunk.visible.resize(chunk.lights.size());
+                    for (size_t k = 0; k < chunk.lights.size(); ++k) {
+                        const auto& light = chunk.lights[k];
+                        chunk.visible[k] = !_scene.Occluded(light.ray, light.distance);
+                    }
+                    nodes[c] = GetTraversalCounters().nodes - visited;
+                });
+                for (auto n : nodes) {
+                    _stats.shadow_nodes += n;
+                }
+            });
+        } else {
+            // NB: Every light sample is referenced once, ordered by key.
+            Timed(&_stats.sort_ms, [&]() {
+                _shadow_refs.clear();
+                for (int c = 0; c < num_chunks; ++c) {
+                    auto& chunk = chunks[c];
+                    chunk.visible.resize(chunk.lights.size());
+                    for (size_t k = 0; k < chunk.lights.size(); ++k) {
+                        _shadow_refs.push_back(
+                                ShadowRef{SortKey(chunk.lights[k].ray, _bounds), c, static_cast<int>(k)});
+                    }
+                }
+                std::stable_sort(_shadow_refs.begin(), _shadow_refs.end(),
+                                 [](const ShadowRef& a, const ShadowRef& b) { return a.key < b.key; });
+            });
+
+            Timed(&_stats.shadow_ms, [&]() {
+                nodes.assign(NumChunks(_shadow_refs.size()), 0);
+                ForChunks(_shadow_refs.size(), num_threads, [&](int c, size_t begin, size_t end) {
+                    const int64_t visited = GetTraversalCounters().nodes;
+                    for (size_t k = begin; k < end; ++k) {
+                        const auto& ref   = _shadow_refs[k];
+                        auto&       chunk = chunks[ref.chunk];
+                        const auto& light = chunk.lights[ref.index];
+                        chunk.visible[ref.index] = !_scene.Occluded(light.ray, light.distance);
+                    }
+                    nodes[c] = GetTraversalCounters().nodes - visited;
+                });
+                for (auto n : nodes) {
+                    _stats.shadow_nodes += n;
+                }
+            });
+        }
+
+        Timed(&_stats.emit_ms, [&]() {
+            rays.clear();
+            for (int c = 0; c < num_chunks; ++c) {
+                const auto& chunk = chunks[c];
+                _stats.shadow_rays += static_cast<int64_t>(chunk.lights.size());
+                for (const auto& shaded : chunk.shaded) {
+                    Vec3f diffuse{0.0, 0.0, 0.0};
+                    Vec3f specular{0.0, 0.0, 0.0};
+                    for (size_t k = shaded.first_light; k < shaded.first_light + shaded.num_lights; ++k) {
+                        if (chunk.visible[k]) {
+                            diffuse  += chunk.lights[k].diffuse;
+                            specular += chunk.lights[k].specular;
+                        }
+                    }
+                    (*radiance)[shaded.pixel] += shaded.weight * shaded.shading.Radiance(diffuse, specular);
+                }
+                rays.insert(rays.end(), chunk.rays.begin(), chunk.rays.end());
+            }
+        });
+    }
+}
+
+const WavefrontStats& WavefrontTracer::GetStats() const {
+    return _stats;
+}
@@ -0,0 +1,247 @@
+#include <cmath>
+#include <algorithm>
+
+#include <raytracer/wide_bvh.hpp>
+
+#ifdef RAYTRACER_HAVE_AVX2
+template <int N>
+uint32_t IntersectChildrenAVX2(const WideNode<N>& node, const Vec3f& orig,
+                               const Vec3f& inv_dir, double tmax, double* tnear);
+#endif
+
+/* ############################################# Quantization ################################################# */
+
+static double Axis(const Vec3f& v, int axis) {
+    return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+static constexpr int kQuantMax = 255;
+
+// NB: Step such that origin + 255 * scale covers hi.
+static double QuantScale(double lo, double hi) {
+    double scale = (hi - lo) / kQuantMax;
+    while (lo + kQuantMax * scale < hi) {
+        scale = std::nextafter(scale, std::numeric_limits<double>::max());
+    }
+    return scale;
+}
+
+// NB: Rounds down, so the decoded value never exceeds v.
+static uint8_t QuantizeLo(double v, double origin, double scale) {
+    if (scale == 0) {
+        return 0;
+    }
+    int q = static_cast<int>(std::floor((v - origin) / scale));
+    q = std::max(0, std::min(q, kQuantMax));
+    while (q > 0 && origin + q * scale > v) {
+        --q;
+    }
+    return static_cast<uint8_t>(q);
+}
+
+// NB: Rounds up, so the decoded value is never below v.
+static uint8_t QuantizeHi(double v, double origin, double scale) {
+    if (scale == 0) {
+        return 0;
+    }
+    int q = static_cast<int>(std::ceil((v - origin) / scale));
+    q = std::max(0, std::min(q, kQuantMax));
+    while (q < kQuantMax && origin + q * scale < v) {
+        ++q;
+    }
+    return static_cast<uint8_t>(q);
+}
+
+/* ############################################# WideBVH Implementation ####################################### */
+
+template <int N>
+WideBVH<N>::WideBVH(const BVH& bvh) {
+    if (bvh.GetNodes().empty()) {
+        return;
+    }
+    _child_of.assign(bvh.GetNodes().size(), -1);
+    _root_of.assign(bvh.GetNodes().size(), -1);
+    Build(bvh, 0);
+    _nodes.shrink_to_fit();
+    _sources.shrink_to_fit();
+}
+
+template <int N>
+int WideBVH<N>::Build(const BVH& bvh, int root) {
+    const auto& nodes = bvh.GetNodes();
+
+    // NB: Open the largest inner child until the node is full,
+    // a leaf root becomes the only child of the node.
+    std::vector<int> children{root};
+    if (nodes[root].count == 0) {
+        children = {root + 1, nodes[root].offset};
+    }
+    while (static_cast<int>(children.size()) < N) {
+        int    best = -1;
+        double best_area = -1;
+        for (int i = 0; i < static_cast<int>(children.size()); ++i) {
+            const auto& node = nodes[children[i]];
+            if (node.count == 0 && node.bounds.SurfaceArea() > best_area) {
+                best      = i;
+                best_area = node.bounds.SurfaceArea();
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+        const int opened = children[best];
+        children[best] = opened + 1;
+        children.push_back(nodes[opened].offset);
+    }
+
+    const int idx = static_cast<int>(_nodes.size());
+    _nodes.push_back(Node{});
+    _sources.push_back(Source{root, {}});
+    _root_of[root] = idx;
+
+    const int num_children = static_cast<int>(children.size());
+    for (int i = 0; i < num_children; ++i) {
+        _sources[idx].children[i] = children[i];
+        _child_of[children[i]]    = idx;
+    }
+
+    for (int i = 0; i < num_children; ++i) {
+        const auto& child = nodes[children[i]];
+        int first = child.offset;
+        if (child.count == 0) {
+            first = Build(bvh, children[i]);
+        }
+        _nodes[idx].child[i] = first;
+        _nodes[idx].count[i] = child.count;
+    }
+    _nodes[idx].num_children = num_children;
+
+    Quantize(bvh, idx);
+    return idx;
+}
+
+template <int N>
+void WideBVH<N>::Quantize(const BVH& bvh, int idx) {
+    const auto& nodes  = bvh.GetNodes();
+    const auto& source = _sources[idx];
+    const auto& box    = nodes[source.root].bounds;
+    auto&       node   = _nodes[idx];
+
+    for (int axis = 0; axis < 3; ++axis) {
+        node.origin[axis] = Axis(box.lo, axis);
+        node.scale[axis]  = QuantScale(Axis(box.lo, axis), Axis(box.hi, axis));
+    }
+
+    for (int i = 0; i < N; ++i) {
+        // NB: Unused lanes are masked out by num_children.
+        if (i >= node.num_children) {
+            for (int axis = 0; axis < 3; ++axis) {
+                node.qlo[axis][i] = 0;
+                node.qhi[axis][i] = 0;
+            }
+            continue;
+        }
+
+        const auto& child = nodes[source.children[i]].bounds;
+        for (int axis = 0; axis < 3; ++axis) {
+            node.qlo[axis][i] = QuantizeLo(Axis(child.lo, axis), node.origin[axis], node.scale[axis]);
+            node.qhi[axis][i] = QuantizeHi(Axis(child.hi, axis), node.origin[axis], node.scale[axis]);
+        }
+    }
+}
+
+template <int N>
+void WideBVH<N>::Refit(const BVH& bvh, const std::vector<int>& changed) {
+    if (_nodes.empty()) {
+        return;
+    }
+
+    // NB: A node depends on the box of its root and of its children.
+    std::vector<int> dirty;
+    for (int n : changed) {
+        if (_child_of[n] >= 0) {
+            dirty.push_back(_child_of[n]);
+        }
+        if (_root_of[n] >= 0) {
+            dirty.push_back(_root_of[n]);
+        }
+    }
+    std::sort(dirty.begin(), dirty.end());
+    dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+
+    for (int idx : dirty) {
+        Quantize(bvh, idx);
+    }
+}
+
+template <int N>
+const std::vector<typename WideBVH<N>::Node>& WideBVH<N>::GetNodes() const {
+    return _nodes;
+}
+
+template <int N>
+size_t WideBVH<N>::GetMemoryUsage() const {
+    return _nodes.size() * sizeof(Node);
+}
+
+template class WideBVH<4>;
+template class WideBVH<8>;
+
+/* ############################################# Child box kernels ############################################ */
+
+template <int N>
+uint32_t IntersectChildrenScalar(const WideNode<N>& node, const Vec3f& orig,
+                                 const Vec3f& inv_dir, double tmax, double* tnear) {
+    // NB: Branch-free slab test of AABB::Intersect for every lane.
+    const double o[3]   = {orig.x, orig.y, orig.z};
+    const double inv[3] = {inv_dir.x, inv_dir.y, inv_dir.z};
+
+    uint32_t mask = 0;
+    for (int i = 0; i < N; ++i) {
+        double t0 = 0;
+        double t1 = tmax;
+        for (int axis = 0; axis < 3; ++axis) {
+            double lo  = node.origin[axis] + node.qlo[axis][i] * node.scale[axis];
+            double hi  = node.origin[axis] + node.qhi[axis][i] * node.scale[axis];
+            double a   = (lo - o[axis]) * inv[axis];
+            double b   = (hi - o[axis]) * inv[axis];
+            double tlo = a > b ? b : a;
+            double thi = a > b ? a : b;
+            t0 = tlo > t0 ? tlo : t0;
+            t1 = thi < t1 ? thi : t1;
+        }
+        tnear[i] = t0;
+        mask |= static_cast<uint32_t>(t0 <= t1) << i;
+    }
+    return mask & ((1u << node.num_children) - 1);
+}
+
+template <int N>
+using ChildrenKernel = uint32_t (*)(const WideNode<N>&, const Vec3f&, const Vec3f&,
+                                    double, double*);
+
+template <int N>
+static ChildrenKernel<N> SelectChildrenKernel() {
+#ifdef RAYTRACER_HAVE_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        return IntersectChildrenAVX2<N>;
+    }
+#endif
+    return IntersectChildrenScalar<N>;
+}
+
+template <int N>
+uint32_t IntersectChildren(const WideNode<N>& node, const Vec3f& orig,
+                           const Vec3f& inv_dir, double tmax, double* tnear) {
+    static const ChildrenKernel<N> kernel = SelectChildrenKernel<N>();
+    return kernel(node, orig, inv_dir, tmax, tnear);
+}
+
+template uint32_t IntersectChildren<4>      (const WideNode<4>&, const Vec3f&, const Vec3f&,
+                                             double, double*);
+template uint32_t IntersectChildren<8>      (const WideNode<8>&, const Vec3f&, const Vec3f&,
+                                             double, double*);
+template uint32_t IntersectChildrenScalar<4>(const WideNode<4>&, const Vec3f&, const Vec3f&,
+                                             double, double*);
+template uint32_t IntersectChildrenScalar<8>(const WideNode<8>&, const Vec3f&, const Vec3f&,
+                                             double, double*);
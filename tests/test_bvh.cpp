@@ -0,0 +1,294 @@
+#include <gtest/gtest.h>
+
+#include <random>
+
+#include <raytracer/geometry.hpp>
+#include <raytracer/wavefront.hpp>
+
+TEST(BVH, BoxHit) {
+    AABB box{{-1, -1, -1}, {1, 1, 1}};
+    Vec3f dir{-1, 0, 0};
+    Vec3f inv_dir{1 / dir.x, 1 / dir.y, 1 / dir.z};
+
+    double tnear = 0;
+    EXPECT_TRUE(box.Intersect({5, 0, 0}, inv_dir, 100, &tnear));
+    EXPECT_DOUBLE_EQ(4, tnear);
+
+    EXPECT_FALSE(box.Intersect({5, 0, 0}, inv_dir, 3, &tnear));
+    EXPECT_FALSE(box.Intersect({5, 2, 0}, inv_dir, 100, &tnear));
+}
+
+TEST(BVH, EmptyScene) {
+    Scene scene{{}, {}, {}};
+
+    EXPECT_TRUE(scene.GetBVH().GetNodes().empty());
+    EXPECT_FALSE(scene.Intersect(Ray{{0, 0, 0}, {0, 0, -1}}).has_value());
+}
+
+TEST(BVH, MatchesLinearScan) {
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> pos(-10, 10);
+    std::uniform_real_distribution<double> rad(0.1, 1.0);
+
+    Objects objects;
+    for (int i = 0; i < 200; ++i) {
+        objects.push_back(std::make_shared<Sphere>(Vec3f{pos(gen), pos(gen), pos(gen)}, rad(gen)));
+    }
+    Objects copy = objects;
+    Scene scene{std::move(copy), {}, {}};
+
+    for (int i = 0; i < 1000; ++i) {
+        Ray ray{{pos(gen), pos(gen), pos(gen)},
+                Vec3f{pos(gen), pos(gen), pos(gen)}.normalize()};
+
+        std::optional<Intersection> expected;
+        for (const auto& obj : objects) {
+            auto hit = obj->intersect(ray);
+            if (hit && (!expected || hit->distance < expected->distance)) {
+                expected = hit;
+            }
+        }
+
+        auto hit = scene.Intersect(ray);
+        ASSERT_EQ(expected.has_value(), hit.has_value());
+        if (hit) {
+            EXPECT_DOUBLE_EQ(expected->distance, hit->distance);
+            EXPECT_NE(nullptr, hit->object);
+        }
+    }
+}
+
+TEST(BVH, PacketMatchesSingleRays) {
+    std::mt19937 gen(7);
+    std::uniform_real_distribution<double> pos(-10, 10);
+    std::uniform_real_distribution<double> rad(0.1, 1.0);
+    std::uniform_real_distribution<double> jitter(-0.2, 0.2);
+
+    Objects objects;
+    for (int i = 0; i < 200; ++i) {
+        objects.push_back(std::make_shared<Sphere>(Vec3f{pos(gen), pos(gen), pos(gen)}, rad(gen)));
+    }
+    Scene scene{std::move(objects), {}, {}};
+
+    for (int i = 0; i < 100; ++i) {
+        // NB: Coherent rays from a common origin around a random direction.
+        Vec3f orig{pos(gen), pos(gen), pos(gen)};
+        Vec3f dir = Vec3f{pos(gen), pos(gen), pos(gen)}.normalize();
+
+        RayPacket packet;
+        packet.size = 1 + i % RayPacket::kMaxSize;
+        for (int lane = 0; lane < packet.size; ++lane) {
+            packet.Set(lane, orig, Vec3f{dir.x + jitter(gen), dir.y + jitter(gen),
+                                         dir.z + jitter(gen)}.normalize());
+        }
+
+        Intersection hits[RayPacket::kMaxSize];
+        auto mask = scene.Intersect(packet, hits);
+        for (int lane = 0; lane < packet.size; ++lane) {
+            auto expected = scene.Intersect(Ray{packet.GetOrig(lane), packet.GetDir(lane)});
+            ASSERT_EQ(expected.has_value(), bool(mask >> lane & 1));
+            if (expected) {
+                EXPECT_EQ(expected->distance, hits[lane].distance);
+                EXPECT_EQ(expected->object, hits[lane].object);
+            }
+        }
+    }
+}
+
+TEST(BVH, WideLayoutsMatchBinary) {
+    std::mt19937 gen(11);
+    std::uniform_real_distribution<double> pos(-10, 10);
+    std::uniform_real_distribution<double> rad(0.1, 1.0);
+
+    Objects objects;
+    for (int i = 0; i < 300; ++i) {
+        objects.push_back(std::make_shared<Sphere>(Vec3f{pos(gen), pos(gen), pos(gen)}, rad(gen)));
+    }
+    Scene scene{std::move(objects), {}, {}};
+
+    std::vector<Ray> rays;
+    for (int i = 0; i < 1000; ++i) {
+        rays.push_back(Ray{{pos(gen), pos(gen), pos(gen)},
+                           Vec3f{pos(gen), pos(gen), pos(gen)}.normalize()});
+    }
+
+    std::vector<std::optional<Intersection>> expected;
+    for (const auto& ray : rays) {
+        expected.push_back(scene.Intersect(ray));
+    }
+
+    for (auto layout : {BVHLayout::kWide4, BVHLayout::kWide8}) {
+        scene.SetBVHLayout(layout);
+        for (int i = 0; i < rays.size(); ++i) {
+            auto hit = scene.Intersect(rays[i]);
+            ASSERT_EQ(expected[i].has_value(), hit.has_value());
+            if (hit) {
+                EXPECT_EQ(expected[i]->distance, hit->distance);
+            }
+            EXPECT_EQ(expected[i].has_value(), scene.Occluded(rays[i], kInfinity));
+        }
+    }
+}
+
+TEST(BVH, WideChildBoxesAreConservative) {
+    std::mt19937 gen(5);
+    std::uniform_real_distribution<double> pos(-100, 100);
+    std::uniform_real_distribution<double> ext(0.0, 3.0);
+
+    std::vector<AABB> bounds;
+    for (int i = 0; i < 500; ++i) {
+        Vec3f lo{pos(gen), pos(gen), pos(gen)};
+        bounds.push_back(AABB{lo, lo + Vec3f{ext(gen), ext(gen), ext(gen)}});
+    }
+    BVH bvh{bounds};
+    WideBVH<8> wide{bvh};
+
+    // NB: Every primitive must lie inside the decoded box of its leaf.
+    int num_primitives = 0;
+    for (const auto& node : wide.GetNodes()) {
+        for (int i = 0; i < node.num_children; ++i) {
+            if (node.count[i] == 0) {
+                continue;
+            }
+            for (int p = node.child[i]; p < node.child[i] + node.count[i]; ++p) {
+                const auto& box = bounds[bvh.GetIndices()[p]];
+                const double lo[3] = {box.lo.x, box.lo.y, box.lo.z};
+                const double hi[3] = {box.hi.x, box.hi.y, box.hi.z};
+                for (int axis = 0; axis < 3; ++axis) {
+                    EXPECT_LE(node.origin[axis] + node.qlo[axis][i] * node.scale[axis], lo[axis]);
+                    EXPECT_GE(node.origin[axis] + node.qhi[axis][i] * node.scale[axis], hi[axis]);
+                }
+                ++num_primitives;
+            }
+        }
+    }
+    EXPECT_EQ(500, num_primitives);
+
+    // NB: The selected kernel must agree with the scalar one bit by bit.
+    for (int r = 0; r < 1000; ++r) {
+        Vec3f orig{pos(gen), pos(gen), pos(gen)};
+        Vec3f dir = Vec3f{pos(gen), pos(gen), pos(gen)}.normalize();
+        Vec3f inv_dir{1 / dir.x, 1 / dir.y, 1 / dir.z};
+        for (const auto& node : wide.GetNodes()) {
+            double t_scalar[8], t_simd[8];
+            auto m_scalar = IntersectChildrenScalar(node, orig, inv_dir, 150, t_scalar);
+            auto m_simd   = IntersectChildren     (node, orig, inv_dir, 150, t_simd);
+            ASSERT_EQ(m_scalar, m_simd);
+            for (int i = 0; i < 8; ++i) {
+                if (m_scalar >> i & 1) {
+                    ASSERT_EQ(t_scalar[i], t_simd[i]);
+                }
+            }
+        }
+    }
+}
+
+TEST(BVH, RefitMatchesRebuild) {
+    std::mt19937 gen(3);
+    std::uniform_real_distribution<double> pos(-10, 10);
+    std::uniform_real_distribution<double> rad(0.1, 1.0);
+    std::uniform_real_distribution<double> step(-0.5, 0.5);
+    std::uniform_int_distribution<int>     pick(0, 199);
+
+    std::vector<Vec3f>  centers;
+    std::vector<double> radii;
+    Objects objects;
+    for (int i = 0; i < 200; ++i) {
+        centers.push_back({pos(gen), pos(gen), pos(gen)});
+        radii.push_back(rad(gen));
+        objects.push_back(std::make_shared<Sphere>(centers.back(), radii.back()));
+    }
+    Objects copy = objects;
+    Scene scene{std::move(copy), {}, {}};
+
+    for (auto layout : {BVHLayout::kBinary, BVHLayout::kWide4, BVHLayout::kWide8}) {
+        scene.SetBVHLayout(layout);
+        for (int frame = 0; frame < 10; ++frame) {
+            std::vector<int> moved;
+            for (int k = 0; k < 3; ++k) {
+                int i = pick(gen);
+                centers[i] = centers[i] + Vec3f{step(gen), step(gen), step(gen)};
+                std::static_pointer_cast<Sphere>(objects[i])->SetGeometry(centers[i], radii[i]);
+                moved.push_back(i);
+            }
+            scene.Refit(moved);
+
+            Objects fresh;
+            for (int i = 0; i < 200; ++i) {
+                fresh.push_back(std::make_shared<Sphere>(centers[i], radii[i]));
+            }
+            Scene expected{std::move(fresh), {}, {}};
+
+            for (int r = 0; r < 100; ++r) {
+                Ray ray{{pos(gen), pos(gen), pos(gen)},
+                        Vec3f{pos(gen), pos(gen), pos(gen)}.normalize()};
+                auto hit  = scene.Intersect(ray);
+                auto want = expected.Intersect(ray);
+                ASSERT_EQ(want.has_value(), hit.has_value());
+                if (hit) {
+                    EXPECT_EQ(want->distance, hit->distance);
+                }
+            }
+        }
+    }
+}
+
+TEST(BVH, RefitVisitsAncestorsOnly) {
+    std::mt19937 gen(9);
+    std::uniform_real_distribution<double> pos(-10, 10);
+
+    std::vector<AABB> bounds;
+    for (int i = 0; i < 1000; ++i) {
+        Vec3f lo{pos(gen), pos(gen), pos(gen)};
+        bounds.push_back(AABB{lo, lo + Vec3f{0.1, 0.1, 0.1}});
+    }
+    BVH bvh{bounds};
+
+    // NB: A moved primitive can only change its leaf and the ancestors.
+    bounds[17] = AABB{{20, 20, 20}, {21, 21, 21}};
+    auto changed = bvh.Refit({17}, bounds);
+    EXPECT_FALSE(changed.empty());
+    EXPECT_LE(changed.size(), BVH::kMaxDepth + 1);
+    EXPECT_EQ(0, changed.back());
+    EXPECT_GE(bvh.GetBounds().hi.x, 21);
+
+    // NB: Unchanged boxes stop the propagation right at the leaf.
+    EXPECT_TRUE(bvh.Refit({17}, bounds).empty());
+
+    // NB: Shuffled primitives make the tree useless.
+    std::vector<int> all(bounds.size());
+    for (int i = 0; i < all.size(); ++i) {
+        Vec3f lo{pos(gen), pos(gen), pos(gen)};
+        bounds[i] = AABB{lo, lo + Vec3f{0.1, 0.1, 0.1}};
+        all[i]    = i;
+    }
+    bvh.Refit(all, bounds);
+    EXPECT_GT(bvh.GetDegradation(), BVH::kRebuildThreshold);
+    EXPECT_DOUBLE_EQ(1.0, BVH{bounds}.GetDegradation());
+}
+
+TEST(BVH, SortKey) {
+    AABB bounds{{0, 0, 0}, {1, 1, 1}};
+    auto key = [&](Vec3f orig, Vec3f dir) { return SortKey(Ray{orig, dir}, bounds); };
+
+    // NB: Direction octant comes first, then the origin.
+    EXPECT_LT(key({1, 1, 1}, {1, 1, 1}), key({0, 0, 0}, {-1, 1, 1}));
+    EXPECT_LT(key({0, 0, 0}, {1, 1, 1}), key({0.5, 0.5, 0.5}, {1, 1, 1}));
+    EXPECT_EQ(key({-5, -5, -5}, {1, 1, 1}), key({0, 0, 0}, {1, 1, 1}));
+    EXPECT_EQ(7ull << 30, key({0, 0, 0}, {-1, -1, -1}));
+}
+
+TEST(BVH, TraversalCounters) {
+    Objects objects;
+    for (int i = 0; i < 8; ++i) {
+        objects.push_back(std::make_shared<Sphere>(Vec3f{3.0 * i, 0, -5}, 1.));
+    }
+    Scene scene{std::move(objects), {}, {}};
+
+    for (auto layout : {BVHLayout::kBinary, BVHLayout::kWide4}) {
+        scene.SetBVHLayout(layout);
+        const int64_t before = GetTraversalCounters().nodes;
+        scene.Intersect(Ray{{0, 0, 0}, {0, 0, -1}});
+        EXPECT_LT(before, GetTraversalCounters().nodes);
+    }
+}
@@ -1,5 +1,8 @@
 #include <gtest/gtest.h>
 
+#include <random>
+#include <cstdint>
+
 #include <raytracer/geometry.hpp>
 
 TEST(Geometry, NoIntersection) {
@@ -16,9 +19,10 @@ TEST(Geometry, HasIntersection) {
     Ray ray{{5, 0, 0}, {-1, 0, 0}};
 
     auto hit = sphere.intersect(ray);
-    auto&& info = hit.value();
-
     EXPECT_TRUE(hit.has_value());
+    EXPECT_DOUBLE_EQ(3, hit->distance);
+
+    auto info = sphere.GetHitInfo(ray, hit.value());
     EXPECT_EQ((Vec3f{2, 0, 0}), info.position);
     EXPECT_EQ((Vec3f{1, 0, 0}), info.normal);
     EXPECT_DOUBLE_EQ(3, info.distance);
@@ -62,3 +66,226 @@ TEST(Geometry, Barycentric) {
     EXPECT_DOUBLE_EQ(0.1, inside.y);
     EXPECT_DOUBLE_EQ(0.1, inside.z);
 }
+
+TEST(Geometry, Occluded) {
+    Sphere sphere({0, 0, 0}, 2.);
+    Ray ray{{5, 0, 0}, {-1, 0, 0}};
+
+    EXPECT_TRUE(sphere.occluded(ray, 4));
+    EXPECT_FALSE(sphere.occluded(ray, 2));
+
+    Scene scene{{std::make_shared<Sphere>(Vec3f{0, 0, 0}, 2.)}, {}, {}};
+    EXPECT_TRUE(scene.Occluded(ray, 4));
+    EXPECT_FALSE(scene.Occluded(ray, 2));
+}
+
+TEST(Geometry, TriangleMesh) {
+    auto buffers = std::make_shared<MeshBuffers>();
+    buffers->px = {0, 1, 1, 0};
+    buffers->py = {0, 0, 1, 1};
+    buffers->pz = {0, 0, 0, 0};
+
+    MeshIndices indices;
+    indices.v = {0, 1, 2, 0, 2, 3};
+
+    TriangleMesh mesh(buffers, std::move(indices));
+    mesh.Commit();
+    EXPECT_EQ(2, mesh.GetTriangleCount());
+
+    Ray ray{{0.25, 0.75, 1}, {0, 0, -1}};
+    auto hit = mesh.intersect(ray);
+    ASSERT_TRUE(hit.has_value());
+    EXPECT_EQ(1, hit->primitive);
+    EXPECT_DOUBLE_EQ(1, hit->distance);
+
+    auto info = mesh.GetHitInfo(ray, hit.value());
+    EXPECT_EQ((Vec3f{0.25, 0.75, 0}), info.position);
+    EXPECT_EQ((Vec3f{0, 0, 1}), info.normal);
+
+    EXPECT_TRUE (mesh.occluded(ray, 2));
+    EXPECT_FALSE(mesh.occluded(ray, 0.5));
+    EXPECT_FALSE(mesh.intersect(ray, 0.5).has_value());
+}
+
+TEST(Geometry, TriangleMeshSetBuffers) {
+    auto buffers = std::make_shared<MeshBuffers>();
+    buffers->px = {0, 1, 1, 0};
+    buffers->py = {0, 0, 1, 1};
+    buffers->pz = {0, 0, 0, 0};
+
+    MeshIndices indices;
+    indices.v = {0, 1, 2, 0, 2, 3};
+
+    auto mesh = std::make_shared<TriangleMesh>(buffers, std::move(indices));
+    Scene scene{{mesh}, {}, {}};
+    scene.SetBVHLayout(BVHLayout::kWide4);
+
+    // NB: Move the quad towards the ray origin.
+    auto moved = std::make_shared<MeshBuffers>(*buffers);
+    moved->pz = {0.5, 0.5, 0.5, 0.5};
+    mesh->SetBuffers(moved);
+    scene.Refit({0});
+
+    Ray ray{{0.25, 0.75, 1}, {0, 0, -1}};
+    auto hit = scene.Intersect(ray);
+    ASSERT_TRUE(hit.has_value());
+    EXPECT_DOUBLE_EQ(0.5, hit->distance);
+    EXPECT_EQ((Vec3f{0.25, 0.75, 0.5}), mesh->GetHitInfo(ray, hit.value()).position);
+    EXPECT_FALSE(scene.Occluded(ray, 0.4));
+}
+
+TEST(Geometry, TransformInverse) {
+    auto t = Transform::Translate({1, 2, 3}) *
+             Transform::Rotate({0, 1, 0}, M_PI / 3) *
+             Transform::Scale({2, 3, 4});
+    auto p = t.Inverse().Point(t.Point({0.5, -1, 2}));
+
+    EXPECT_NEAR(0.5, p.x, 1e-12);
+    EXPECT_NEAR(-1,  p.y, 1e-12);
+    EXPECT_NEAR(2,   p.z, 1e-12);
+
+    auto r = Transform::Rotate({0, 0, 1}, M_PI / 2).Vector({1, 0, 0});
+    EXPECT_NEAR(0, r.x, 1e-12);
+    EXPECT_NEAR(1, r.y, 1e-12);
+}
+
+TEST(Geometry, Instance) {
+    auto buffers = std::make_shared<MeshBuffers>();
+    buffers->px = {0, 1, 1, 0};
+    buffers->py = {0, 0, 1, 1};
+    buffers->pz = {0, 0, 0, 0};
+
+    MeshIndices indices;
+    indices.v = {0, 1, 2, 0, 2, 3};
+
+    auto mesh = std::make_shared<TriangleMesh>(buffers, std::move(indices));
+    mesh->Commit();
+
+    // NB: The quad scaled by 2 and turned to face +x at x = -3.
+    auto transform = Transform::Translate({-3, 0, 0}) *
+                     Transform::Rotate({0, 1, 0}, M_PI / 2) *
+                     Transform::Scale({2, 2, 2});
+    Instance instance(mesh, transform);
+
+    auto bounds = instance.GetBounds();
+    EXPECT_NEAR(-3, bounds.lo.x, 1e-12);
+    EXPECT_NEAR(-3, bounds.hi.x, 1e-12);
+    EXPECT_NEAR( 2, bounds.hi.y, 1e-12);
+
+    Ray ray{{2, 1, -1}, {-1, 0, 0}};
+    auto hit = instance.intersect(ray);
+    ASSERT_TRUE(hit.has_value());
+    EXPECT_NEAR(5, hit->distance, 1e-12);
+    EXPECT_FALSE(instance.intersect(ray, 4).has_value());
+    EXPECT_TRUE (instance.occluded(ray, 6));
+    EXPECT_FALSE(instance.occluded(ray, 4));
+
+    auto info = instance.GetHitInfo(ray, hit.value());
+    EXPECT_NEAR(-3, info.position.x, 1e-12);
+    EXPECT_NEAR( 1, info.position.y, 1e-12);
+    EXPECT_NEAR(-1, info.position.z, 1e-12);
+    EXPECT_NEAR( 1, info.normal.x,   1e-12);
+    EXPECT_EQ(&mesh->GetMaterial(), info.material);
+}
+
+TEST(Geometry, InstancesShareScene) {
+    auto sphere = std::make_shared<Sphere>(Vec3f{0, 0, 0}, 1.);
+
+    Objects objects;
+    for (int i = 0; i < 10; ++i) {
+        auto t = Transform::Translate({3.0 * i, 0, -5}) * Transform::Scale({0.5, 0.5, 0.5});
+        objects.push_back(std::make_shared<Instance>(sphere, t));
+    }
+    Scene scene{std::move(objects), {}, {}};
+
+    for (int i = 0; i < 10; ++i) {
+        auto hit = scene.Intersect(Ray{{3.0 * i, 0, 0}, {0, 0, -1}});
+        ASSERT_TRUE(hit.has_value());
+        EXPECT_NEAR(4.5, hit->distance, 1e-12);
+        EXPECT_EQ(scene.GetObjects()[i].get(), hit->object);
+    }
+    EXPECT_FALSE(scene.Intersect(Ray{{1.5, 0, 0}, {0, 0, -1}}).has_value());
+}
+
+TEST(Geometry, InstancesRefit) {
+    auto buffers = std::make_shared<MeshBuffers>();
+    buffers->px = {0, 1, 1, 0};
+    buffers->py = {0, 0, 1, 1};
+    buffers->pz = {0, 0, 0, 0};
+
+    MeshIndices indices;
+    indices.v = {0, 1, 2, 0, 2, 3};
+
+    auto mesh = std::make_shared<TriangleMesh>(buffers, std::move(indices));
+    mesh->Commit();
+
+    Objects objects;
+    for (int i = 0; i < 2; ++i) {
+        objects.push_back(std::make_shared<Instance>(mesh, Transform::Translate({20.0 * i, 0, -5})));
+    }
+    Scene scene{std::move(objects), {}, {}};
+    scene.SetBVHLayout(BVHLayout::kWide4);
+    EXPECT_NE(mesh->GetBVH().GetNodes().size() * sizeof(BVH::Node), mesh->GetBVHMemoryUsage());
+
+    // NB: Move the quad out of the bounds the instances had.
+    auto moved = std::make_shared<MeshBuffers>(*buffers);
+    moved->px = {10, 11, 11, 10};
+    mesh->SetBuffers(moved);
+    scene.Refit({0, 1});
+
+    for (int i = 0; i < 2; ++i) {
+        auto hit = scene.Intersect(Ray{{20.0 * i + 10.5, 0.5, 0}, {0, 0, -1}});
+        ASSERT_TRUE(hit.has_value());
+        EXPECT_DOUBLE_EQ(5, hit->distance);
+        EXPECT_EQ(scene.GetObjects()[i].get(), hit->object);
+    }
+    EXPECT_FALSE(scene.Intersect(Ray{{0.5, 0.5, 0}, {0, 0, -1}}).has_value());
+}
+
+TEST(Geometry, PacketKernelsMatch) {
+    std::mt19937 gen(7);
+    std::uniform_real_distribution<double> pos(-1, 1);
+
+    for (int i = 0; i < 10000; ++i) {
+        TrianglePacket packet{};
+        for (int lane = 0; lane < TrianglePacket::kWidth; ++lane) {
+            packet.tri[lane] = lane;
+            packet.v0x[lane] = pos(gen);
+            packet.v0y[lane] = pos(gen);
+            packet.v0z[lane] = pos(gen) - 2;
+            packet.e1x[lane] = pos(gen);
+            packet.e1y[lane] = pos(gen);
+            packet.e1z[lane] = pos(gen);
+            packet.e2x[lane] = pos(gen);
+            packet.e2y[lane] = pos(gen);
+            packet.e2z[lane] = pos(gen);
+        }
+        Ray ray{{0, 0, 0}, Vec3f{pos(gen), pos(gen), -1}.normalize()};
+
+        double t0 = 10, u0 = 0, v0 = 0;
+        double t1 = 10, u1 = 0, v1 = 0;
+        int lane0 = IntersectPacketScalar(packet, ray, &t0, &u0, &v0);
+        int lane1 = IntersectPacket      (packet, ray, &t1, &u1, &v1);
+
+        ASSERT_EQ(lane0, lane1);
+        EXPECT_EQ(t0, t1);
+        EXPECT_EQ(u0, u1);
+        EXPECT_EQ(v0, v1);
+    }
+}
+
+TEST(Geometry, MatfLayout) {
+    Matf mat(13, 5);
+    EXPECT_EQ(13u, mat.GetW());
+    EXPECT_EQ(5u, mat.GetH());
+    EXPECT_EQ(16u, mat.GetStride());
+
+    for (size_t y = 0; y < mat.GetH(); ++y) {
+        EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(mat.Row(y)) % Matf::kAlignment);
+        EXPECT_EQ(Vec3f(0, 0, 0), mat(12, y));
+    }
+
+    mat(3, 2) = {1, 2, 3};
+    EXPECT_EQ(&mat(3, 2), mat.Row(2) + 3);
+    EXPECT_EQ(Vec3f(1, 2, 3), mat.Row(2)[3]);
+}
@@ -1,5 +1,10 @@
 #include <gtest/gtest.h>
 
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <stdexcept>
+
 #include <raytracer/image.hpp>
 
 TEST(Image, CopyCtor) {
@@ -7,3 +12,83 @@ TEST(Image, CopyCtor) {
     auto copy = img;
     // NB: Check destructor failing in destructor
 }
+
+TEST(Image, Layout) {
+    Image img(10, 3, 3);
+    EXPECT_EQ(3, img.Channels());
+    EXPECT_EQ(64u, img.Stride());
+    for (int y = 0; y < img.Height(); ++y) {
+        EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(img.Row(y)) % Image::kAlignment);
+    }
+
+    img.SetPixel(RGB{1, 2, 3}, 2, 4);
+    EXPECT_EQ(3, img.Row(2)[4 * 3 + 2]);
+    EXPECT_TRUE((RGB{1, 2, 3}) == img.GetPixel(2, 4));
+
+    Image rgba(2, 2);
+    EXPECT_EQ(4, rgba.Channels());
+    EXPECT_EQ(255, rgba.Row(1)[7]);
+}
+
+TEST(Image, WrapsCallerMemory) {
+    // NB: Rows padded to 12 bytes.
+    std::vector<uint8_t> buffer(12 * 2, 7);
+    Image img(buffer.data(), 2, 2, 4, 12);
+    EXPECT_EQ(12u, img.Stride());
+    EXPECT_EQ(buffer.data() + 12, img.Row(1));
+    EXPECT_TRUE((RGB{7, 7, 7}) == img.GetPixel(1, 1));
+
+    img.SetPixel(RGB{1, 2, 3}, 1, 1);
+    EXPECT_EQ((std::vector<uint8_t>{1, 2, 3, 7}),
+              std::vector<uint8_t>(buffer.begin() + 16, buffer.begin() + 20));
+
+    // NB: Copies share the caller memory too.
+    auto copy = img;
+    copy.SetPixel(RGB{4, 5, 6}, 0, 0);
+    EXPECT_EQ(4, buffer[0]);
+
+    EXPECT_THROW(Image(buffer.data(), 4, 2, 4, 12), std::logic_error);
+    EXPECT_THROW(Image(buffer.data(), 2, 2, 2), std::logic_error);
+}
+
+TEST(Image, WriteAndRead) {
+    for (int channels : {3, 4}) {
+        const std::string path = ::testing::TempDir() + "image.png";
+        Image img(5, 4, channels);
+        for (int y = 0; y < img.Height(); ++y) {
+            for (int x = 0; x < img.Width(); ++x) {
+                img.SetPixel(RGB{x * 50, y * 60, x + y}, y, x);
+            }
+        }
+        img.Write(path);
+
+        Image read(path);
+        EXPECT_EQ(channels, read.Channels());
+        ASSERT_EQ(5, read.Width());
+        ASSERT_EQ(4, read.Height());
+        for (int y = 0; y < img.Height(); ++y) {
+            for (int x = 0; x < img.Width(); ++x) {
+                EXPECT_TRUE(img.GetPixel(y, x) == read.GetPixel(y, x));
+            }
+        }
+        std::remove(path.c_str());
+    }
+}
+
+TEST(Image, PngWriter) {
+    const std::string path = ::testing::TempDir() + "rows.png";
+    const uint8_t row[] = {10, 20, 30, 40, 50, 60};
+    {
+        PngWriter writer(path, 2, 2);
+        writer.WriteRow(row);
+        EXPECT_THROW(writer.Finish(), std::logic_error);
+        writer.WriteRow(row);
+        EXPECT_THROW(writer.WriteRow(row), std::logic_error);
+        writer.Finish();
+    }
+
+    Image read(path);
+    EXPECT_EQ(3, read.Channels());
+    EXPECT_TRUE((RGB{40, 50, 60}) == read.GetPixel(1, 1));
+    std::remove(path.c_str());
+}
@@ -0,0 +1,100 @@
+#include <gtest/gtest.h>
+
+#include <set>
+#include <algorithm>
+#include <array>
+#include <sstream>
+#include <fstream>
+#include <filesystem>
+
+#include <raytracer/parser.hpp>
+
+// NB: Triangles of the mesh as sorted position index triples.
+static std::set<std::array<int, 3>> GetTriangles(const TriangleMesh& mesh) {
+    std::set<std::array<int, 3>> triangles;
+    const auto& v = mesh.GetIndices().v;
+    for (size_t k = 0; k < v.size(); k += 3) {
+        std::array<int, 3> triangle{v[k], v[k + 1], v[k + 2]};
+        std::sort(triangle.begin(), triangle.end());
+        triangles.insert(triangle);
+    }
+    return triangles;
+}
+
+TEST(Parser, FacesFormOneMesh) {
+    // NB: A quad and a triangle on five shared vertices.
+    std::stringstream ss{
+        "v 0 0 0\n"
+        "v 1 0 0\n"
+        "v 1 1 0\n"
+        "v 0 1 0\n"
+        "v 2 0 0\n"
+        "vn 0 0 2\n"
+        "f 1//1 2//1 3//1 4//1\n"
+        "f 2 5 3\n"
+        "P 0 0 5 1 1 1\n"};
+    auto scene = Parse(&ss, ".");
+
+    ASSERT_EQ(1u, scene.GetObjects().size());
+    EXPECT_EQ(1u, scene.GetLights().size());
+    auto mesh = std::dynamic_pointer_cast<TriangleMesh>(scene.GetObjects()[0]);
+    ASSERT_TRUE(mesh);
+    EXPECT_EQ(3, mesh->GetTriangleCount());
+
+    // NB: Vertices are stored once and indexed, not copied per triangle.
+    const auto& buffers = *mesh->GetBuffers();
+    EXPECT_EQ(5u, buffers.px.size());
+    EXPECT_EQ((Vec3f{2, 0, 0}), buffers.GetPosition(4));
+    EXPECT_EQ((Vec3f{0, 0, 1}), buffers.GetNormal(0));
+
+    const std::set<std::array<int, 3>> expected{{0, 1, 2}, {0, 2, 3}, {1, 2, 4}};
+    EXPECT_EQ(expected, GetTriangles(*mesh));
+
+    // NB: Only the quad has normals.
+    const auto& indices = mesh->GetIndices();
+    ASSERT_EQ(9u, indices.vn.size());
+    int without_normals = 0;
+    for (int vn : indices.vn) {
+        without_normals += vn == -1;
+    }
+    EXPECT_EQ(3, without_normals);
+    EXPECT_TRUE(indices.vt.empty());
+
+    auto hit = scene.Intersect(Ray{{1.5, 0.25, 1}, {0, 0, -1}});
+    ASSERT_TRUE(hit.has_value());
+    EXPECT_EQ(mesh.get(), hit->object);
+}
+
+TEST(Parser, MaterialsShareBuffers) {
+    const auto dir = std::filesystem::temp_directory_path() / "raytracer-parser-test";
+    std::filesystem::create_directories(dir);
+    std::ofstream(dir / "two.mtl") << "newmtl red\nKd 1 0 0\nnewmtl blue\nKd 0 0 1\n";
+
+    std::stringstream ss{
+        "mtllib two.mtl\n"
+        "v 0 0 0\n"
+        "v 1 0 0\n"
+        "v 1 1 0\n"
+        "v 0 1 0\n"
+        "usemtl red\n"
+        "f 1 2 3\n"
+        "usemtl blue\n"
+        "f 1 3 4\n"
+        "usemtl red\n"
+        "f 4 3 2\n"};
+    auto scene = Parse(&ss, dir.string());
+    std::filesystem::remove_all(dir);
+
+    // NB: One mesh per material, both indexing the same buffers.
+    ASSERT_EQ(2u, scene.GetObjects().size());
+    auto red  = std::dynamic_pointer_cast<TriangleMesh>(scene.GetObjects()[0]);
+    auto blue = std::dynamic_pointer_cast<TriangleMesh>(scene.GetObjects()[1]);
+    ASSERT_TRUE(red && blue);
+    EXPECT_EQ(red->GetBuffers(), blue->GetBuffers());
+    EXPECT_EQ(4u, red->GetBuffers()->px.size());
+
+    EXPECT_EQ((Vec3f{1, 0, 0}), red->GetMaterial().Kd);
+    EXPECT_EQ((Vec3f{0, 0, 1}), blue->GetMaterial().Kd);
+    EXPECT_EQ((std::set<std::array<int, 3>>{{0, 1, 2}, {1, 2, 3}}), GetTriangles(*red));
+    EXPECT_EQ((std::set<std::array<int, 3>>{{0, 2, 3}}), GetTriangles(*blue));
+}
@@ -0,0 +1,664 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <fstream>
+#include <filesystem>
+#include <thread>
+#include <random>
+#include <cmath>
+#include <limits>
+
+#include <raytracer/render.hpp>
+#include <raytracer/checkpoint.hpp>
+#include <raytracer/postprocess.hpp>
+
+static Scene MakeScene() {
+    Material material;
+    material.Kd = {0.8, 0.3, 0.2};
+    material.Ka = {0.1, 0.1, 0.1};
+
+    Scene scene{{std::make_shared<Sphere>(Vec3f{0, 0, -3}, 1., material)}, {}, {}};
+    scene.AddLight(Light{{2, 2, 0}, {1, 1, 1}});
+    return scene;
+}
+
+static bool SameImages(const Image& a, const Image& b) {
+    if (a.Width() != b.Width() || a.Height() != b.Height()) {
+        return false;
+    }
+    for (int y = 0; y < a.Height(); ++y) {
+        for (int x = 0; x < a.Width(); ++x) {
+            if (!(a.GetPixel(y, x) == b.GetPixel(y, x))) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+TEST(Render, ProgressiveFirstPassMatchesRender) {
+    auto scene = MakeScene();
+    CameraOptions camera(40, 30);
+    RenderOptions options{3};
+    options.tile_size = 8;
+
+    ProgressiveRenderer renderer(scene, camera, options);
+    EXPECT_EQ(0, renderer.GetPassCount());
+
+    auto first = renderer.RenderPass();
+    EXPECT_EQ(1, renderer.GetPassCount());
+    EXPECT_TRUE(SameImages(Render(scene, camera, options), first));
+    EXPECT_TRUE(SameImages(first, renderer.GetSnapshot()));
+}
+
+TEST(Render, ProgressiveResumes) {
+    auto scene = MakeScene();
+    CameraOptions camera(40, 30);
+    RenderOptions options{3};
+    options.tile_size = 8;
+
+    // NB: Stopping between passes doesn't change the result.
+    ProgressiveRenderer a(scene, camera, options);
+    ProgressiveRenderer b(scene, camera, options);
+    for (int i = 0; i < 3; ++i) {
+        a.RenderPass();
+    }
+    b.RenderPass();
+    b.GetSnapshot();
+    b.RenderPass();
+    b.GetSnapshot();
+    b.RenderPass();
+
+    EXPECT_TRUE(SameImages(a.RenderPass(), b.RenderPass()));
+    EXPECT_EQ(4, b.GetPassCount());
+}
+
+static double MeanError(const Image& a, const Image& b) {
+    double error = 0;
+    for (int y = 0; y < a.Height(); ++y) {
+        for (int x = 0; x < a.Width(); ++x) {
+            auto p = a.GetPixel(y, x);
+            auto q = b.GetPixel(y, x);
+            error += std::abs(p.r - q.r) + std::abs(p.g - q.g) + std::abs(p.b - q.b);
+        }
+    }
+    return error / (a.Width() * a.Height());
+}
+
+TEST(Render, AdaptiveSampling) {
+    // NB: Flat emissive spheres, so averaging samples doesn't change
+    // the brightest pixel the image is tone mapped with.
+    Material a;
+    a.Ke = {1, 0.5, 0.2};
+    Material b;
+    b.Ke = {0.2, 0.4, 0.6};
+
+    Scene scene{{std::make_shared<Sphere>(Vec3f{-0.6, 0, -3}, 1., a),
+                 std::make_shared<Sphere>(Vec3f{1, 0.5, -4}, 1., b)}, {}, {}};
+    CameraOptions camera(40, 30);
+    RenderOptions options{3};
+
+    RenderStats one_stats;
+    auto one = Render(scene, camera, options, &one_stats);
+    EXPECT_EQ(40 * 30, one_stats.samples);
+
+    options.min_samples = 16;
+    options.max_samples = 16;
+    auto reference = Render(scene, camera, options);
+
+    options.min_samples = 1;
+    RenderStats stats;
+    auto adaptive = Render(scene, camera, options, &stats);
+
+    // NB: Extra samples only go to the silhouette of the sphere.
+    EXPECT_LT(stats.samples, 2 * one_stats.samples);
+    EXPECT_LT(MeanError(adaptive, reference), 0.5 * MeanError(one, reference));
+
+    options.min_samples = 0;
+    EXPECT_THROW(Render(scene, camera, options), std::logic_error);
+}
+
+TEST(Render, ThroughputCulling) {
+    Material glass;
+    glass.Ks    = {0.3, 0.3, 0.3};
+    glass.Tr    = 0.9;
+    glass.Ni    = 1.5;
+    glass.illum = 4;
+
+    Scene scene{{std::make_shared<Sphere>(Vec3f{0, 0, -3}, 1., glass),
+                 std::make_shared<Sphere>(Vec3f{1, 0, -5}, 1., glass)}, {}, {}};
+    scene.AddLight(Light{{2, 2, 0}, {1, 1, 1}});
+    CameraOptions camera(40, 30);
+
+    // NB: Every reflected and refracted branch is weaker than that.
+    RenderOptions options{16};
+    options.min_throughput = 1.5;
+    auto culled = Render(scene, camera, options);
+    EXPECT_TRUE(SameImages(Render(scene, camera, RenderOptions{1}), culled));
+
+    options.min_throughput   = 0.1;
+    options.russian_roulette = true;
+    EXPECT_TRUE(SameImages(Render(scene, camera, options), Render(scene, camera, options)));
+}
+
+TEST(Render, WavefrontMatchesRender) {
+    Material glass;
+    glass.Kd    = {0.2, 0.2, 0.2};
+    glass.Ks    = {0.3, 0.3, 0.3};
+    glass.Tr    = 0.7;
+    glass.Ni    = 1.5;
+    glass.illum = 4;
+
+    auto scene = MakeScene();
+    Scene glass_scene{{std::make_shared<Sphere>(Vec3f{0, 0, -3}, 1., glass),
+                       std::make_shared<Sphere>(Vec3f{1, 0, -5}, 1.)}, {}, {}};
+    glass_scene.AddLight(Light{{2, 2, 0}, {1, 1, 1}});
+
+    CameraOptions camera(40, 30);
+    RenderOptions options{4};
+    options.num_threads = 3;
+
+    RenderStats stats;
+    EXPECT_TRUE(SameImages(Render(scene, camera, options), RenderWavefront(scene, camera, options)));
+    EXPECT_TRUE(SameImages(Render(glass_scene, camera, options),
+                           RenderWavefront(glass_scene, camera, options, &stats)));
+    EXPECT_LT(1, stats.wavefront.waves);
+    EXPECT_GE(options.depth, stats.wavefront.waves);
+    EXPECT_LT(40 * 30, stats.wavefront.rays);
+}
+
+TEST(Render, SortedWavefront) {
+    Material mirror;
+    mirror.Kd    = {0.2, 0.2, 0.2};
+    mirror.Ks    = {0.7, 0.7, 0.7};
+    mirror.illum = 3;
+
+    Objects objects;
+    for (int i = 0; i < 5; ++i) {
+        objects.push_back(std::make_shared<Sphere>(Vec3f{1.1 * i - 2.2, 0, -4}, 0.5, mirror));
+    }
+    Scene scene{std::move(objects), {}, {}};
+    scene.AddLight(Light{{2, 2, 0}, {1, 1, 1}});
+
+    CameraOptions camera(40, 30);
+    RenderOptions options{4};
+
+    RenderStats unsorted;
+    auto expected = RenderWavefront(scene, camera, options, &unsorted);
+
+    options.sort_rays = true;
+    RenderStats sorted;
+    auto image = RenderWavefront(scene, camera, options, &sorted);
+
+    EXPECT_LT(MeanError(expected, image), 0.01);
+    EXPECT_EQ(unsorted.wavefront.rays, sorted.wavefront.rays);
+    EXPECT_EQ(unsorted.wavefront.shadow_rays, sorted.wavefront.shadow_rays);
+    EXPECT_LT(0, sorted.wavefront.nodes);
+    EXPECT_LT(0, sorted.wavefront.shadow_nodes);
+    // NB: Without sorting no time is booked as sorting.
+    EXPECT_EQ(0.0, unsorted.wavefront.sort_ms);
+    EXPECT_LT(0, unsorted.wavefront.shadow_nodes);
+}
+
+TEST(Render, Budgeted) {
+    auto scene = MakeScene();
+    CameraOptions camera(40, 30);
+    RenderOptions options{3};
+    options.tile_size = 8;
+
+    RenderQuality quality;
+    auto image = RenderBudgeted(scene, camera, options, 1e6, &quality);
+    EXPECT_TRUE(SameImages(Render(scene, camera, options), image));
+    EXPECT_TRUE(quality.complete);
+    EXPECT_EQ(3, quality.depth);
+    EXPECT_EQ(1, quality.min_samples);
+    EXPECT_DOUBLE_EQ(1.0, quality.coverage);
+
+    options.max_samples = 4;
+    RenderBudgeted(scene, camera, options, 1e6, &quality);
+    EXPECT_TRUE(quality.complete);
+    EXPECT_EQ(4, quality.min_samples);
+    EXPECT_EQ(4, quality.max_samples);
+
+    // NB: Budgets beyond the range of the clock never run out.
+    for (double budget_ms : {1e13, 1e300, std::numeric_limits<double>::infinity()}) {
+        RenderBudgeted(scene, camera, options, budget_ms, &quality);
+        EXPECT_TRUE(quality.complete);
+    }
+
+    // NB: No tile is started once the budget has run out.
+    RenderBudgeted(scene, camera, options, -std::numeric_limits<double>::infinity(), &quality);
+    EXPECT_FALSE(quality.complete);
+    RenderBudgeted(scene, camera, options, 0, &quality);
+    EXPECT_FALSE(quality.complete);
+    EXPECT_EQ(0, quality.depth);
+    EXPECT_EQ(0, quality.max_samples);
+    EXPECT_DOUBLE_EQ(0.0, quality.coverage);
+}
+
+TEST(Render, Async) {
+    auto scene = MakeScene();
+    CameraOptions camera(40, 30);
+    RenderOptions options{3};
+    options.tile_size   = 8;
+    options.num_threads = 2;
+
+    std::atomic<int> tiles{0};
+    auto handle = RenderAsync(scene, camera, options, [&](const Tile& tile, const Matf& radiance) {
+        EXPECT_EQ(40, radiance.GetW());
+        EXPECT_LT(tile.x0, tile.x1);
+        ++tiles;
+    });
+    // NB: Waits for the render before the image is asked for.
+    int stats_tiles = 0;
+    for (const auto& thread : handle.GetStats().threads) {
+        stats_tiles += thread.tiles;
+    }
+    EXPECT_TRUE(handle.IsDone());
+    EXPECT_EQ(5 * 4, stats_tiles);
+    auto image = handle.Get();
+
+    EXPECT_TRUE(handle.IsDone());
+    EXPECT_DOUBLE_EQ(1.0, handle.GetProgress());
+    EXPECT_EQ(5 * 4, tiles);
+    EXPECT_TRUE(SameImages(Render(scene, camera, options), image));
+}
+
+TEST(Render, AsyncCancel) {
+    auto scene = MakeScene();
+    CameraOptions camera(40, 30);
+    RenderOptions options{3};
+    options.tile_size   = 8;
+    options.num_threads = 1;
+
+    // NB: The first tile cancels the render, no other one is started.
+    std::atomic<int> tiles{0};
+    RenderHandle* self = nullptr;
+    std::atomic<bool> started{false};
+    auto handle = RenderAsync(scene, camera, options, [&](const Tile&, const Matf&) {
+        while (!started) {
+        }
+        self->Cancel();
+        ++tiles;
+    });
+    self    = &handle;
+    started = true;
+
+    EXPECT_THROW(handle.Get(), RenderCancelled);
+    EXPECT_EQ(1, tiles);
+    EXPECT_GT(1.0, handle.GetProgress());
+
+    options.tile_size = 0;
+    auto failed = RenderAsync(scene, camera, options);
+    EXPECT_THROW(failed.Get(), std::logic_error);
+}
+
+TEST(Render, AsyncCancelAfterCompletion) {
+    auto scene = MakeScene();
+    CameraOptions camera(40, 30);
+    RenderOptions options{3};
+    options.tile_size = 8;
+
+    auto handle = RenderAsync(scene, camera, options);
+    while (!handle.WaitFor(10)) {
+    }
+    handle.Cancel();
+    EXPECT_TRUE(SameImages(Render(scene, camera, options), handle.Get()));
+}
+
+TEST(Render, Preview) {
+    auto scene = MakeScene();
+    CameraOptions camera(40, 30);
+    RenderOptions options{3};
+    options.tile_size    = 8;
+    options.preview_step = 4;
+
+    std::vector<int> steps;
+    auto image = RenderPreview(scene, camera, options, [&](const Image& level, int step) {
+        EXPECT_EQ(40, level.Width());
+        EXPECT_EQ(3, level.Channels());
+        if (step > 1) {
+            // NB: Blocks are filled with their top left pixel.
+            EXPECT_TRUE(level.GetPixel(0, 0) == level.GetPixel(step - 1, step - 1));
+        }
+        steps.push_back(step);
+    });
+
+    EXPECT_EQ((std::vector<int>{4, 2, 1}), steps);
+    EXPECT_TRUE(SameImages(Render(scene, camera, options), image));
+
+    options.preview_step = 3;
+    EXPECT_THROW(RenderPreview(scene, camera, options, {}), std::logic_error);
+}
+
+static bool Exists(const std::string& path) {
+    return std::ifstream(path).good();
+}
+
+TEST(Render, Checkpoint) {
+    const std::string path = ::testing::TempDir() + "render.ckpt";
+    auto scene = MakeScene();
+    CameraOptions camera(40, 30);
+    RenderOptions options{3};
+    options.tile_size = 8;
+
+    std::remove(path.c_str());
+    const auto image = RenderCheckpointed(scene, camera, options, CheckpointOptions{path, 1, {}});
+    EXPECT_TRUE(SameImages(Render(scene, camera, options), image));
+    EXPECT_FALSE(Exists(path));
+
+    // NB: A checkpoint with the center tile, rows 8-15 and columns 16-23,
+    // done and black, the resumed render keeps it.
+    const RGB black{0, 0, 0};
+    ASSERT_FALSE(image.GetPixel(15, 20) == black);
+
+    Checkpoint checkpoint;
+    checkpoint.width     = 40;
+    checkpoint.height    = 30;
+    checkpoint.tile_size = 8;
+    checkpoint.done.assign(5 * 4, 0);
+    checkpoint.done[1 * 5 + 2] = 1;
+
+    CheckpointOptions checkpoint_options{path, 60000, {}};
+    checkpoint.fingerprint = 1;
+    WriteCheckpoint(path, checkpoint, Matf(40, 30));
+    EXPECT_THROW(RenderCheckpointed(scene, camera, options, checkpoint_options), std::logic_error);
+
+    // NB: Same options, but a light or the geometry differ.
+    checkpoint.fingerprint = CheckpointFingerprint(scene, camera, options);
+    auto lit = MakeScene();
+    lit.AddLight(Light{{-2, 2, 0}, {0.5, 0.5, 0.5}});
+    WriteCheckpoint(path, checkpoint, Matf(40, 30));
+    EXPECT_THROW(RenderCheckpointed(lit, camera, options, checkpoint_options), std::logic_error);
+    Scene other{{std::make_shared<Sphere>(Vec3f{0, 0, -3}, 1.5)}, {}, {}};
+    other.AddLight(Light{{2, 2, 0}, {1, 1, 1}});
+    EXPECT_THROW(RenderCheckpointed(other, camera, options, checkpoint_options), std::logic_error);
+
+    WriteCheckpoint(path, checkpoint, Matf(40, 30));
+    const auto resumed = RenderCheckpointed(scene, camera, options, checkpoint_options);
+    EXPECT_TRUE(resumed.GetPixel(15, 20) == black);
+    EXPECT_TRUE(resumed.GetPixel(8, 16) == black);
+    EXPECT_TRUE(resumed.GetPixel(15, 23) == black);
+    EXPECT_FALSE(Exists(path));
+
+    options.max_samples = 2;
+    EXPECT_THROW(RenderCheckpointed(scene, camera, options, checkpoint_options), std::logic_error);
+
+    options.max_samples = 1;
+    for (double interval_ms : {0.0, -1.0}) {
+        EXPECT_THROW(RenderCheckpointed(scene, camera, options, CheckpointOptions{path, interval_ms, {}}),
+                     std::logic_error);
+    }
+    EXPECT_FALSE(Exists(path));
+}
+
+TEST(Render, CheckpointRoundtrip) {
+    const std::string path = ::testing::TempDir() + "roundtrip.ckpt";
+    Checkpoint checkpoint{20, 10, 8, 42, {1, 0, 0, 1, 1, 0}};
+    Matf radiance(20, 10);
+    for (int y = 0; y < 10; ++y) {
+        for (int x = 0; x < 20; ++x) {
+            radiance(x, y) = Vec3f{x * 0.5, y * 0.25, 1.0 + x * y};
+        }
+    }
+    WriteCheckpoint(path, checkpoint, radiance);
+
+    Checkpoint read;
+    Matf read_radiance(20, 10);
+    ASSERT_TRUE(ReadCheckpoint(path, &read, &read_radiance));
+    EXPECT_EQ(checkpoint.fingerprint, read.fingerprint);
+    EXPECT_EQ(checkpoint.done, read.done);
+    // NB: Tile 0 is done, tile 1 is not.
+    EXPECT_EQ(radiance(7, 7).z, read_radiance(7, 7).z);
+    EXPECT_EQ(0.0, read_radiance(8, 0).x);
+    // NB: Clipped tile 5 on the right is not done, tile 4 in the middle is.
+    EXPECT_EQ(radiance(15, 9).y, read_radiance(15, 9).y);
+    std::remove(path.c_str());
+
+    EXPECT_FALSE(ReadCheckpoint(path, &read, &read_radiance));
+}
+
+TEST(Render, GammaTable) {
+    const auto& table = GetGammaTable();
+    auto byte = [](double t) { return static_cast<int>(std::pow(t, 1 / 2.2) * 255); };
+    for (int b = 1; b < 256; ++b) {
+        const double t = table.thresholds[b];
+        EXPECT_GE(byte(t), b);
+        EXPECT_LT(byte(std::nextafter(t, 0.0)), b);
+
+        // NB: The cell of a threshold switches to b exactly at it.
+        const int cell = GammaTable::Cell(t);
+        EXPECT_EQ(b, table.cell_bytes[cell] + (t >= table.cell_thresholds[cell]));
+    }
+    EXPECT_LT(std::ldexp(1.0, GammaTable::kMinExponent), table.thresholds[1]);
+    EXPECT_EQ(GammaTable::kNumCells - 1, GammaTable::Cell(1.0));
+}
+
+TEST(Render, ToneMapMatchesReference) {
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> exponent(-8, 3);
+
+    for (double C : {1e-3, 0.7, 1.0, 5.0, 300.0}) {
+        // NB: An odd count covers the tail after the vectorized part.
+        std::vector<Vec3f> pixels(10001);
+        auto channel = [&]() { return std::min(C, std::pow(10, exponent(gen))); };
+        for (auto& p : pixels) {
+            p = Vec3f{channel(), channel(), channel()};
+        }
+        pixels[0] = Vec3f{C, 0, 1e-300};
+        // NB: Brighter than C, saturates.
+        pixels[1] = Vec3f{C * 2, C * 1e6, std::nextafter(C, 2 * C)};
+
+        std::vector<uint8_t> expected(pixels.size() * 3), actual(pixels.size() * 3);
+        ToneMapScalar(pixels.data(), pixels.size(), C, expected.data());
+        ToneMap(pixels.data(), pixels.size(), C, actual.data());
+        EXPECT_EQ(expected, actual);
+    }
+}
+
+TEST(Render, RenderInto) {
+    auto scene = MakeScene();
+    CameraOptions camera(40, 30);
+    RenderOptions options{3};
+    const auto expected = Render(scene, camera, options);
+
+    // NB: RGBA with padded rows, alpha and padding are kept.
+    const size_t stride = 40 * 4 + 8;
+    std::vector<uint8_t> buffer(stride * 30, 9);
+    Image image(buffer.data(), 40, 30, 4, stride);
+    RenderInto(scene, camera, options, &image);
+
+    EXPECT_TRUE(SameImages(expected, image));
+    EXPECT_EQ(9, buffer[3]);
+    EXPECT_EQ(9, buffer[stride - 1]);
+
+    Image small(10, 10);
+    EXPECT_THROW(RenderInto(scene, camera, options, &small), std::logic_error);
+}
+
+static int MaxDiff(const Image& a, const Image& b) {
+    int diff = 0;
+    for (int y = 0; y < a.Height(); ++y) {
+        for (int x = 0; x < a.Width(); ++x) {
+            const auto p = a.GetPixel(y, x);
+            const auto q = b.GetPixel(y, x);
+            diff = std::max({diff, std::abs(p.r - q.r), std::abs(p.g - q.g), std::abs(p.b - q.b)});
+        }
+    }
+    return diff;
+}
+
+TEST(Render, Hdr) {
+    auto scene = MakeScene();
+    CameraOptions camera(40, 30);
+    RenderOptions options{3};
+
+    auto radiance = RenderHdr(scene, camera, options);
+    ASSERT_EQ(40u * 30 * 3, radiance.size());
+
+    // NB: RGBA with padded rows.
+    const size_t stride = 40 * 4 + 4;
+    std::vector<float> rgba(stride * 30, -1.0f);
+    RenderHdr(scene, camera, options, HdrBuffer{rgba.data(), 40, 30, 4, stride});
+    for (int y = 0; y < 30; ++y) {
+        for (int x = 0; x < 40; ++x) {
+            for (int c = 0; c < 3; ++c) {
+                ASSERT_EQ(radiance[(y * 40 + x) * 3 + c], rgba[y * stride + x * 4 + c]);
+            }
+            ASSERT_EQ(1.0f, rgba[y * stride + x * 4 + 3]);
+        }
+        ASSERT_EQ(-1.0f, rgba[y * stride + stride - 1]);
+    }
+
+    const auto expected = Render(scene, camera, options);
+    EXPECT_LE(MaxDiff(expected, ToneMapHdr(HdrBuffer{radiance.data(), 40, 30})), 1);
+    EXPECT_LE(MaxDiff(expected, ToneMapHdr(HdrBuffer{rgba.data(), 40, 30, 4, stride})), 1);
+
+    EXPECT_THROW(RenderHdr(scene, camera, options, HdrBuffer{rgba.data(), 40, 30, 4, 100}),
+                 std::logic_error);
+}
+
+TEST(Render, HdrBands) {
+    auto scene = MakeScene();
+    CameraOptions camera(40, 150);
+    RenderOptions options{3};
+    options.tile_size = 8;
+
+    for (int packet_size : {0, 4}) {
+        options.packet_size = packet_size;
+
+        // NB: The radiance of the whole frame as RenderFrame computes it.
+        std::vector<float> expected(40 * 150 * 3);
+        auto handle = RenderAsync(scene, camera, options, [&](const Tile& tile, const Matf& radiance) {
+            for (int y = tile.y0; y < tile.y1; ++y) {
+                for (int x = tile.x0; x < tile.x1; ++x) {
+                    expected[(y * 40 + x) * 3 + 0] = static_cast<float>(radiance(x, y).x);
+                    expected[(y * 40 + x) * 3 + 1] = static_cast<float>(radiance(x, y).y);
+                    expected[(y * 40 + x) * 3 + 2] = static_cast<float>(radiance(x, y).z);
+                }
+            }
+        });
+        handle.Get();
+
+        RenderStats stats;
+        std::vector<float> radiance(40 * 150 * 3);
+        RenderHdr(scene, camera, options, HdrBuffer{radiance.data(), 40, 150}, &stats);
+        EXPECT_EQ(expected, radiance);
+        EXPECT_EQ(40 * 150, stats.samples);
+
+        int tiles = 0;
+        for (const auto& thread : stats.threads) {
+            tiles += thread.tiles;
+        }
+        // NB: Bands of 64 rows, the tiles of each start on its first row.
+        EXPECT_EQ(5 * (8 + 8 + 3), tiles);
+    }
+}
+
+TEST(Render, HdrKeepsRadiance) {
+    Material material;
+    material.Ke = {3, 0.5, 0.25};
+    Scene scene{{std::make_shared<Sphere>(Vec3f{0, 0, -3}, 1., material)}, {}, {}};
+
+    auto radiance = RenderHdr(scene, CameraOptions(8, 8), RenderOptions{2});
+    const float* center = &radiance[(4 * 8 + 4) * 3];
+    EXPECT_EQ(3.0f, center[0]);
+    EXPECT_EQ(0.5f, center[1]);
+    EXPECT_EQ(0.25f, center[2]);
+    EXPECT_EQ(0.0f, radiance[0]);
+}
+
+TEST(Render, Streamed) {
+    Material material;
+    material.Ke = {1, 0.5, 0.2};
+    Scene scene{{std::make_shared<Sphere>(Vec3f{0, 0, -3}, 1., material)}, {}, {}};
+    CameraOptions camera(40, 30);
+    RenderOptions options{2};
+    const auto expected = Render(scene, camera, options);
+
+    StreamOptions stream;
+    stream.band_height = 7;
+    stream.tone_max    = 1;
+
+    for (int packet_size : {0, 4}) {
+        options.packet_size = packet_size;
+        Image image(40, 30);
+        std::vector<int> bands;
+        RenderStreamed(scene, camera, options, stream, [&](const Image& band, int y0) {
+            EXPECT_EQ(std::min(7, 30 - y0), band.Height());
+            for (int y = 0; y < band.Height(); ++y) {
+                for (int x = 0; x < band.Width(); ++x) {
+                    image.SetPixel(band.GetPixel(y, x), y0 + y, x);
+                }
+            }
+            bands.push_back(y0);
+        });
+        EXPECT_EQ((std::vector<int>{0, 7, 14, 21, 28}), bands);
+        EXPECT_TRUE(SameImages(expected, image));
+    }
+
+    stream.band_height = 0;
+    EXPECT_THROW(RenderStreamed(scene, camera, options, stream, {}), std::logic_error);
+}
+
+TEST(Render, StreamedToPng) {
+    const std::string path = ::testing::TempDir() + "streamed.png";
+    auto scene = MakeScene();
+    CameraOptions camera(40, 30);
+    RenderOptions options{3};
+
+    // NB: An estimate from every pixel finds the maximum of Render.
+    StreamOptions stream;
+    stream.band_height   = 16;
+    stream.estimate_step = 1;
+    RenderToPng(scene, camera, options, stream, path);
+    EXPECT_TRUE(SameImages(Render(scene, camera, options), Image(path)));
+
+    // NB: A coarse estimate might miss the brightest pixels, they saturate.
+    stream.estimate_step = 8;
+    RenderToPng(scene, camera, options, stream, path);
+    EXPECT_LT(MeanError(Render(scene, camera, options), Image(path)), 8);
+    std::remove(path.c_str());
+}
+
+TEST(Render, InvalidTileSize) {
+    auto scene = MakeScene();
+    CameraOptions camera(40, 30);
+    RenderOptions options{3};
+    options.tile_size = 0;
+
+    EXPECT_THROW(ProgressiveRenderer(scene, camera, options), std::logic_error);
+    EXPECT_THROW(Render(scene, camera, options), std::logic_error);
+    EXPECT_THROW(RenderCheckpointed(scene, camera, options,
+                                    CheckpointOptions{::testing::TempDir() + "invalid.ckpt", 60000, {}}),
+                 std::logic_error);
+}
+
+TEST(Render, CheckpointWriteFailure) {
+    namespace fs = std::filesystem;
+    const fs::path dir = fs::path(::testing::TempDir()) / "checkpoints";
+    fs::create_directories(dir);
+
+    auto scene = MakeScene();
+    CameraOptions camera(400, 300);
+    RenderOptions options{3};
+    options.tile_size = 8;
+
+    // NB: Once the first checkpoint is written, its directory is removed,
+    // so every later one fails.
+    std::atomic<int> errors{0};
+    CheckpointOptions checkpoint_options{(dir / "render.ckpt").string(), 5,
+                                         [&](const std::string&) { ++errors; }};
+
+    std::thread remover([&]() {
+        while (!fs::exists(checkpoint_options.path)) {
+            std::this_thread::yield();
+        }
+        fs::remove_all(dir);
+    });
+    const auto image = RenderCheckpointed(scene, camera, options, checkpoint_options);
+    remover.join();
+
+    EXPECT_GT(errors, 0);
+    EXPECT_TRUE(SameImages(Render(scene, camera, options), image));
+}
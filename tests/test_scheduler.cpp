@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <stdexcept>
+
+#include <raytracer/scheduler.hpp>
+
+TEST(Scheduler, MortonCode) {
+    EXPECT_EQ(0u, MortonCode(0, 0));
+    EXPECT_EQ(1u, MortonCode(1, 0));
+    EXPECT_EQ(2u, MortonCode(0, 1));
+    EXPECT_EQ(3u, MortonCode(1, 1));
+    EXPECT_EQ(0b110110u, MortonCode(0b110, 0b101));
+}
+
+TEST(Scheduler, CoversEveryPixelOnce) {
+    const int width = 100, height = 37;
+    TileScheduler scheduler(width, height, 16, 4);
+    EXPECT_EQ(4, scheduler.GetNumThreads());
+    EXPECT_EQ(7 * 3, scheduler.GetTiles().size());
+
+    std::vector<std::atomic<int>> visits(width * height);
+    scheduler.Run([&](const Tile& tile, int thread) {
+        ASSERT_GE(thread, 0);
+        ASSERT_LT(thread, 4);
+        for (int y = tile.y0; y < tile.y1; ++y) {
+            for (int x = tile.x0; x < tile.x1; ++x) {
+                ++visits[y * width + x];
+            }
+        }
+    });
+
+    for (const auto& v : visits) {
+        EXPECT_EQ(1, v);
+    }
+
+    int tiles = 0;
+    for (const auto& stats : scheduler.GetStats()) {
+        tiles += stats.tiles;
+        EXPECT_GE(stats.idle_ms, 0.0);
+    }
+    EXPECT_EQ(scheduler.GetTiles().size(), tiles);
+}
+
+TEST(Scheduler, RethrowsErrors) {
+    TileScheduler scheduler(64, 64, 8, 3);
+    EXPECT_THROW(scheduler.Run([](const Tile& tile, int) {
+        if (tile.x0 == 32 && tile.y0 == 32) {
+            throw std::runtime_error("tile failed");
+        }
+    }), std::runtime_error);
+}
+
+TEST(Scheduler, ParallelFor) {
+    std::vector<int> visits(1000, 0);
+    ParallelFor(static_cast<int>(visits.size()), 4, [&](int i) { ++visits[i]; });
+    for (const auto& v : visits) {
+        EXPECT_EQ(1, v);
+    }
+
+    EXPECT_THROW(ParallelFor(100, 4, [](int i) {
+        if (i == 50) {
+            throw std::runtime_error("item failed");
+        }
+    }), std::runtime_error);
+}
+
+TEST(Scheduler, Cancel) {
+    TileScheduler scheduler(64, 64, 8, 2);
+    std::atomic<int> tiles{0};
+    EXPECT_FALSE(scheduler.Run([&](const Tile&, int) {
+        if (++tiles == 5) {
+            scheduler.Cancel();
+        }
+    }));
+    EXPECT_LT(tiles, static_cast<int>(scheduler.GetTiles().size()));
+
+    tiles = 0;
+    EXPECT_TRUE(scheduler.Run([&](const Tile&, int) { ++tiles; }));
+    EXPECT_EQ(static_cast<int>(scheduler.GetTiles().size()), tiles);
+}
+
+TEST(Scheduler, InvalidTileSize) {
+    EXPECT_THROW(TileScheduler(64, 64, 0), std::logic_error);
+    EXPECT_THROW(TileScheduler(64, 64, -8), std::logic_error);
+}